@@ -12,6 +12,28 @@
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <hdf5.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_BLOSC
+#include <blosc.h>
+#endif
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
 
 #define MAXCTSMPIX 1440
 #define MAXCTSMLIN 720
@@ -26,6 +48,35 @@
 #define MAXPFT 15
 #define MAXCFTRAW 32
 #define MAXCFT 64
+#define MAXCROPTYPE 5
+
+#define MAXNCINPUTFILES 16
+#define MAXNCINPUTVARS 64
+#define MAXNCVARDIMS 4
+#define MAXSLICECACHE 512
+#define MAXCHUNKTHREADS 32
+#define MAXCHUNKCACHE 268435456
+#define MAXCHUNKCACHETOTAL 1073741824
+#define ZARRMETABYTES 65536
+#define ZARRRAW 0
+#define ZARRZLIB 1
+#define ZARRZSTD 2
+#define ZARRBLOSC 3
+#define BLOCKREADVARS 32
+#define ROWCHUNKLIN 16
+#define MAXALLOCGRIDS 1024
+#define DISKCACHEHEADER 4096
+#define DISKCACHEHASHBYTES 1048576
+#define ASYNCREADSLOTS 64
+#define MAXSLICESTRIDES 256
+#define PLANREADGAP 65536
+#define MAXEXTRAPSEARCH 16
+#define MAXEXTRAPRING 4
+#define EXTRAPHEATBLOCK 40
+#define LANDTILESIZE 32
+#define OUTPUTHEADERPAD 65536
+#define OUTPUTALIGN 4096
+#define OUTPUTBUFFERBYTES 8388608
 
 #define firsttreepft 1
 #define lasttreepft  8
@@ -65,6 +116,7 @@ long MAXOUTPIX = MAXCTSMPIX;
 long MAXOUTLIN = MAXCTSMLIN;
 long OUTLONOFFSET = 0;
 long OUTLATOFFSET = 0;
+long OUTLATSOUTHOFFSET = 0;
 float OUTPIXSIZE = CTSMPIXSIZE;
 float OUTLLX = CTSMLLX;
 float OUTLLY = CTSMLLY;
@@ -142,14 +194,34 @@ char cftrawparamfile[1024];
 char cftparamfile[1024];
 int flipLUHgrids;
 int includeOcean;
+char extrapstatsfile[1024];
 
 char PFTluhtype[MAXPFT][256];
 char CFTRAWluhtype[MAXCFTRAW][256];
 char CFTluhtype[MAXCFT][256];
 
 float *tempGrid;
-float *tempflipGrid;
-float *tempextrapGrid;
+float *rowchunkGrid;
+long rowchunklin = 0;
+float *tempextrapGrid[MAXCROPTYPE];
+float *extrapCROPGrid[MAXCROPTYPE];
+float *extrapFERTGrid[MAXCROPTYPE];
+char *extrapCHANGEGrid;
+int *extrapCHANGESUMGrid;
+int extrapcachevalid = 0;
+
+/* Optional extrapolation instrumentation, enabled by extrapstatsfile in the namelist */
+int extrapstats = 0;
+char extrapcropname[MAXCROPTYPE][256] = {"C3ANN", "C4ANN", "C3PER", "C4PER", "C3NFX"};
+long extrapdirectcount[MAXCROPTYPE];
+long extrapringcount[MAXCROPTYPE][MAXEXTRAPRING];
+long extrapfallbackcount[MAXCROPTYPE];
+long extrapvisitcount[MAXCROPTYPE];
+long extrapcellcount;
+double extrapseconds;
+long extrapheatlin;
+long extrapheatpix;
+long *extrapHEATGrid;
 float *tempoutGrid;
 float *secdfCROPINGrid;
 float *secdfOTHERINGrid;
@@ -165,6 +237,20 @@ float inEDGEE;
 float inEDGES;
 float inEDGEW;
 float *inLAT;
+
+/* Output rows within 30 degrees of the equator that hold land, the only rows unrepresented LULCC is computed for */
+
+long tropicfirstlin = 0;
+long tropicendlin = 0;
+
+/* Tiles of LANDTILESIZE x LANDTILESIZE output cells flagged 1 when any cell is on the land mask */
+
+long landtilelin;
+long landtilepix;
+char *landtileGrid;
+long landtilecount = 0;
+long landfirstlin = 0;
+long landendlin = 0;
 float *inLATIXY;
 float *inLON;
 float *inLONGXY;
@@ -191,6 +277,19 @@ float *inC3PERPCTCFTGrid[MAXCFTRAW];
 float *inC4PERPCTCFTGrid[MAXCFTRAW];
 float *inC3NFXPCTCFTGrid[MAXCFTRAW];
 
+/* Contiguous [layer][lat][lon] stacks behind the per layer grid pointers above */
+
+float *inCURRENTPCTPFTStack;
+float *inCURRENTPCTCFTStack;
+float *inFORESTPCTPFTStack;
+float *inPASTUREPCTPFTStack;
+float *inOTHERPCTPFTStack;
+float *inC3ANNPCTCFTStack;
+float *inC4ANNPCTCFTStack;
+float *inC3PERPCTCFTStack;
+float *inC4PERPCTCFTStack;
+float *inC3NFXPCTCFTStack;
+
 float *inBASEPRIMFGrid;
 float *inBASEPRIMNGrid;
 float *inBASESECDFGrid;
@@ -228,6 +327,18 @@ float *inPREVDELTAC3PERGrid;
 float *inPREVDELTAC4PERGrid;
 float *inPREVDELTAC3NFXGrid;
 
+/* Two year rolling window of the LUH state slices used for the PREVDELTA grids, the */
+/* inCURR grids point into the slot holding the current year                         */
+
+#define MAXSTATEWINDOW 9
+
+float *inSTATEWINDOWGrid[2][MAXSTATEWINDOW];
+int statewindowyearindex[2] = {-1, -1};
+int statewindowcurrent = 0;
+char statewindowname[MAXSTATEWINDOW][256] = {"secdf", "secdn", "pastr", "range", "c3ann", "c4ann", "c3per", "c4per", "c3nfx"};
+float **statewindowcurrGrid[MAXSTATEWINDOW] = {&inCURRSECDFGrid, &inCURRSECDNGrid, &inCURRPASTRGrid, &inCURRRANGEGrid, &inCURRC3ANNGrid, &inCURRC4ANNGrid, &inCURRC3PERGrid, &inCURRC4PERGrid, &inCURRC3NFXGrid};
+float **statewindowdeltaGrid[MAXSTATEWINDOW] = {&inPREVDELTASECDFGrid, &inPREVDELTASECDNGrid, &inPREVDELTAPASTRGrid, &inPREVDELTARANGEGrid, &inPREVDELTAC3ANNGrid, &inPREVDELTAC4ANNGrid, &inPREVDELTAC3PERGrid, &inPREVDELTAC4PERGrid, &inPREVDELTAC3NFXGrid};
+
 float *inHARVESTVH1Grid;
 float *inHARVESTVH2Grid;
 float *inHARVESTSH1Grid;
@@ -335,16 +446,212 @@ double *outFERTNITROdblGrid[MAXCFT];
 double *outUNREPPFTdblGrid[MAXPFT];
 double *outUNREPCFTdblGrid[MAXCFT];
 
+/* The layers of the 3D double outputs are views into contiguous [layer][lat][lon] stacks */
+/* so each variable is written with a single nc_put_var_double                          */
+
+double *outPCTPFTdblStack;
+double *outPCTCFTdblStack;
+double *outFERTNITROdblStack;
+double *outUNREPPFTdblStack;
+double *outUNREPCFTdblStack;
+
 double *outRBIOHVH1dblGrid;
 double *outRBIOHVH2dblGrid;
 double *outRBIOHSH1dblGrid;
 double *outRBIOHSH2dblGrid;
 double *outRBIOHSH3dblGrid;
+double *outGRAZINGdblGrid;
 
 /* Out Surface Data NetCDF variables */
-int  stat;  /* return status */
+int  ncstat;  /* return status */
 int  ncid;  /* netCDF id */
 
+/* Input files stay open for the whole run, keyed by canonical path, with variable ids, */
+/* dimension lengths and chunk sizes resolved once per file                             */
+
+int ncinputfilecount = 0;
+int ncinputfileindex = -1;
+char ncinputfilename[MAXNCINPUTFILES][PATH_MAX];
+int ncinputncid[MAXNCINPUTFILES];
+int ncinputvarcount[MAXNCINPUTFILES];
+char ncinputvarname[MAXNCINPUTFILES][MAXNCINPUTVARS][NC_MAX_NAME+1];
+int ncinputvarid[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvarndims[MAXNCINPUTFILES][MAXNCINPUTVARS];
+size_t ncinputvardimlen[MAXNCINPUTFILES][MAXNCINPUTVARS][MAXNCVARDIMS];
+size_t ncinputvarchunk[MAXNCINPUTFILES][MAXNCINPUTVARS][MAXNCVARDIMS];
+
+/* Chunked variables read through NetCDF get a chunk cache holding one whole time chunk, */
+/* while the raised caches of all open variables stay within MAXCHUNKCACHETOTAL. Reads   */
+/* are counted by whether they fall in the same time chunk as the previous read          */
+
+long ncinputvarlastchunk[MAXNCINPUTFILES][MAXNCINPUTVARS];
+long chunkcachebytes = 0;
+long chunksametimereads = 0;
+long chunknewtimereads = 0;
+
+/* Classic, 64 bit offset and CDF5 inputs are mapped read only and float slabs are copied */
+/* straight out of the mapping, other formats and types go through the NetCDF library     */
+
+int ncinputformat[MAXNCINPUTFILES];
+char *ncinputmap[MAXNCINPUTFILES];
+int ncinputmapfile[MAXNCINPUTFILES];
+long long ncinputmapsize[MAXNCINPUTFILES];
+long long ncinputrecsize[MAXNCINPUTFILES];
+long long ncinputvarbegin[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvarrecord[MAXNCINPUTFILES][MAXNCINPUTVARS];
+long classicmapreads = 0;
+double classicadvisedbytes = 0.0;
+double classicreleasedbytes = 0.0;
+
+/* NetCDF-4 inputs are also opened through HDF5 so the raw deflate and shuffle chunks of */
+/* float variables can be read directly and inflated on chunkthreads threads            */
+
+int chunkthreads = 1;
+hid_t ncinputh5file[MAXNCINPUTFILES];
+hid_t ncinputvarh5[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvarshuffle[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvardeflate[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvarswap[MAXNCINPUTFILES][MAXNCINPUTVARS];
+hsize_t ncinputvarh5chunk[MAXNCINPUTFILES][MAXNCINPUTVARS][MAXNCVARDIMS];
+long h5chunkreads = 0;
+long h5chunkcount = 0;
+
+/* Zarr v2 and v3 directory stores stand in for NetCDF files, each chunk file of a slab is */
+/* read, decoded and placed on chunkthreads threads through the slab globals below        */
+
+int ncinputzarr[MAXNCINPUTFILES];
+int ncinputvarzarrcodec[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvarzarrbytes[MAXNCINPUTFILES][MAXNCINPUTVARS];
+char ncinputvarzarrseparator[MAXNCINPUTFILES][MAXNCINPUTVARS];
+int ncinputvarzarrprefix[MAXNCINPUTFILES][MAXNCINPUTVARS];
+float ncinputvarzarrfill[MAXNCINPUTFILES][MAXNCINPUTVARS];
+long zarrslabreads = 0;
+long zarrchunkcount = 0;
+long zarrchunkmissing = 0;
+
+/* Chunks of the slab being assembled, handed out to the threads in order */
+
+pthread_mutex_t h5chunklock = PTHREAD_MUTEX_INITIALIZER;
+long h5chunktotal;
+long h5chunknext;
+int h5chunkfailed;
+unsigned char **h5chunkraw;
+hsize_t *h5chunkrawsize;
+uint32_t *h5chunkmask;
+hsize_t (*h5chunkorigin)[MAXNCVARDIMS];
+int h5slabfile, h5slabvar, h5slabndims, h5slabflip;
+size_t *h5slabstart;
+size_t *h5slabcount;
+float *h5slabGrid;
+
+/* Slices already read, keyed on file, variable, indices and flip, so the same slice */
+/* requested by different readers or years is only read once. Least recently used   */
+/* slices are evicted to stay within slicecachebudget, pinned slices are not evicted */
+/* before they have been reused once.                                                 */
+
+int slicecachecount = 0;
+long slicecachebudget = 1024L * 1048576L;
+long slicecachebytes = 0;
+long slicecacheclock = 0;
+int slicecachepinning = 0;
+unsigned long slicecachekey[MAXSLICECACHE];
+int slicecachefile[MAXSLICECACHE];
+char slicecachevar[MAXSLICECACHE][NC_MAX_NAME+1];
+int slicecacheindex1[MAXSLICECACHE];
+int slicecacheindex2[MAXSLICECACHE];
+int slicecacheflip[MAXSLICECACHE];
+long slicecacheused[MAXSLICECACHE];
+int slicecachepinned[MAXSLICECACHE];
+int slicecachepending[MAXSLICECACHE];
+long slicecachesize[MAXSLICECACHE];
+float *slicecacheGrid[MAXSLICECACHE];
+long slicecachehits = 0;
+long slicecachemisses = 0;
+long slicecacheevictions = 0;
+double slicecachebytessaved = 0.0;
+
+/* With slicecachecompress (HAVE_LZ4 builds) slices are held LZ4 compressed when that saves */
+/* at least an eighth, slicecachesize is then the compressed size charged to the budget     */
+
+int slicecachecompress = 0;
+char *slicecachepackbuffer = NULL;
+float *slicecacheunpackGrid = NULL;
+
+/* LUH state and management readers fetch blockreadyears years of a variable in one slab, */
+/* the years after the requested one wait in the slice cache for the following years      */
+
+int blockreading = 0;
+int blockreadyears = 1;
+float *blockreadGrid;
+long blockreads = 0;
+
+/* Optional on disk cache of preprocessed slices shared between runs, enabled by slicecachedir */
+
+int diskcacheenabled = 0;
+char diskcachedir[1024];
+long long ncinputfilesize[MAXNCINPUTFILES];
+long long ncinputfilemtime[MAXNCINPUTFILES];
+unsigned long long ncinputfileinode[MAXNCINPUTFILES];
+unsigned long long ncinputfiledevice[MAXNCINPUTFILES];
+unsigned long ncinputfilehash[MAXNCINPUTFILES];
+long diskcachehits = 0;
+long diskcachemapped = 0;
+long diskcachewrites = 0;
+
+/* Slices read a year apart are remembered per file, variable, layer and flip so the next    */
+/* year can be read ahead while the current year is computed. Mapped classic inputs get page  */
+/* cache advice, disk cache slices are read on up to chunkthreads threads, or through io_uring */
+/* when built with HAVE_LIBURING, into free slice cache space only. A slice still being read   */
+/* holds its async read slot in slicecachepending and findslicecache waits for it.             */
+
+int slicestridecount = 0;
+int slicestridefile[MAXSLICESTRIDES];
+char slicestridevar[MAXSLICESTRIDES][NC_MAX_NAME+1];
+int slicestrideindex1[MAXSLICESTRIDES];
+int slicestrideindex2[MAXSLICESTRIDES];
+int slicestrideflip[MAXSLICESTRIDES];
+int slicestridestep[MAXSLICESTRIDES];
+long slicestrideround[MAXSLICESTRIDES];
+long slicestrideadvanced[MAXSLICESTRIDES];
+int slicestridewhole[MAXSLICESTRIDES];
+long prefetchround = 0;
+int asyncreadstate[ASYNCREADSLOTS];
+int asyncreadfd[ASYNCREADSLOTS];
+long asyncreadresult[ASYNCREADSLOTS];
+struct iovec asyncreadiov[ASYNCREADSLOTS][2];
+char asyncreadheader[ASYNCREADSLOTS][DISKCACHEHEADER];
+char asyncreadkey[ASYNCREADSLOTS][DISKCACHEHEADER];
+int asyncreadthreads = 0;
+pthread_mutex_t asyncreadlock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t asyncreadqueued = PTHREAD_COND_INITIALIZER;
+pthread_cond_t asyncreaddone = PTHREAD_COND_INITIALIZER;
+#ifdef HAVE_LIBURING
+struct io_uring asyncreadring;
+int asyncreadringready = -1;
+#endif
+long prefetchreads = 0;
+long prefetchrejected = 0;
+
+/* At the start of a year the whole slices expected from mapped classic inputs are sorted by */
+/* file and byte offset, runs closer than PLANREADGAP are read ahead as one stream and the   */
+/* slices are copied into free slice cache space in that order                              */
+
+int planreadcount = 0;
+int planreadstride[MAXSLICESTRIDES];
+int planreadvar[MAXSLICESTRIDES];
+int planreadindex1[MAXSLICESTRIDES];
+long long planreadfirst[MAXSLICESTRIDES];
+long long planreadend[MAXSLICESTRIDES];
+int planreadorder[MAXSLICESTRIDES];
+long planreadruns = 0;
+long planreadslices = 0;
+
+/* Page aligned grid allocations, the disk cache maps slices straight over these */
+
+long allocgridcount = 0;
+char *allocgridbase[MAXALLOCGRIDS];
+size_t allocgridsize[MAXALLOCGRIDS];
+
 /* dimension ids */
 int natpft_dim;
 int cft_dim;
@@ -424,6 +731,7 @@ int readnamelist(char *namelist) {
   FILE *namelistfile;
   char templine[1024];
   char fieldname[256];
+  char fieldvalue[1024];
   char *token;
   int tokencount;
 
@@ -470,6 +778,48 @@ int readnamelist(char *namelist) {
   fscanf(namelistfile,"%s %d",fieldname,&flipLUHgrids);
   fscanf(namelistfile,"%s %d",fieldname,&includeOcean);
 
+  /* Optional entries may follow in any order as name value pairs */
+  
+  chunkthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  
+  while (fscanf(namelistfile,"%s %s",fieldname,fieldvalue) == 2) {
+      if (strcmp(fieldname,"extrapstatsfile") == 0) {
+          sprintf(extrapstatsfile,"%s",fieldvalue);
+          extrapstats = 1;
+      }
+      else if (strcmp(fieldname,"slicecachebudgetmb") == 0) {
+          slicecachebudget = atol(fieldvalue) * 1048576L;
+      }
+      else if (strcmp(fieldname,"slicecachedir") == 0) {
+          sprintf(diskcachedir,"%s",fieldvalue);
+          diskcacheenabled = 1;
+      }
+      else if (strcmp(fieldname,"chunkthreads") == 0) {
+          chunkthreads = atoi(fieldvalue);
+      }
+      else if (strcmp(fieldname,"slicecachecompress") == 0) {
+          slicecachecompress = atoi(fieldvalue);
+#ifndef HAVE_LZ4
+          if (slicecachecompress != 0) {
+              printf("slicecachecompress needs a build with HAVE_LZ4, slices are kept uncompressed\n");
+              slicecachecompress = 0;
+          }
+#endif
+      }
+      else {
+          printf("Unknown namelist entry: %s\n",fieldname);
+      }
+  }
+  
+  if (chunkthreads < 1) {
+      chunkthreads = 1;
+  }
+  if (chunkthreads > MAXCHUNKTHREADS) {
+      chunkthreads = MAXCHUNKTHREADS;
+  }
+
+  fclose(namelistfile);
+
   return 0;
 
 }
@@ -498,8 +848,16 @@ int setregionoptions() {
   OUTLLX = lllon;
   OUTLLY = lllat;
   
-  OUTLATOFFSET = (long) (90.0 - urlat) / OUTPIXSIZE;
-  OUTLONOFFSET = (long) (lllon + 180.0) / OUTPIXSIZE;
+  /* Window offsets are in rows and columns of the global 0.25 degree inputs */
+
+  OUTLATOFFSET = (long) lround((90.0 - urlat) / CTSMPIXSIZE);
+  OUTLATSOUTHOFFSET = (long) lround((lllat + 90.0) / CTSMPIXSIZE);
+  OUTLONOFFSET = (long) lround((lllon + 180.0) / CTSMPIXSIZE);
+
+  if (OUTLATOFFSET < 0 || OUTLATSOUTHOFFSET < 0 || OUTLONOFFSET < 0 || OUTLATOFFSET + MAXOUTLIN > MAXCTSMLIN || OUTLATSOUTHOFFSET + MAXOUTLIN > MAXCTSMLIN || OUTLONOFFSET + MAXOUTPIX > MAXCTSMPIX) {
+      printf("Region %f %f %f %f does not fit in the %d x %d input grids\n",lllon,lllat,urlon,urlat,MAXCTSMLIN,MAXCTSMPIX);
+      exit(1);
+  }
 
   OUTDATASIZE = MAXOUTPIX * MAXOUTLIN * sizeof(float);
   OUTDBLDATASIZE = MAXOUTPIX * MAXOUTLIN * sizeof(double);
@@ -508,199 +866,278 @@ int setregionoptions() {
 
 }
 
+void *allocgrid(size_t gridsize) {
+
+  /* Anonymous mapping rounded to whole pages, so cached slices can be mapped over it */
+
+  size_t pagesize, mapsize;
+  void *gridbase;
+  
+  pagesize = sysconf(_SC_PAGESIZE);
+  mapsize = (gridsize + pagesize - 1) / pagesize * pagesize;
+  
+  gridbase = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (gridbase == MAP_FAILED) {
+      return NULL;
+  }
+  
+  if (allocgridcount < MAXALLOCGRIDS) {
+      allocgridbase[allocgridcount] = (char *) gridbase;
+      allocgridsize[allocgridcount] = mapsize;
+      allocgridcount++;
+  }
+  
+  return gridbase;
+
+}
+
+int ismappablegrid(float *targetgrid, size_t gridsize) {
+
+  size_t pagesize, mapsize;
+  long gridid;
+  char *target = (char *) targetgrid;
+  
+  pagesize = sysconf(_SC_PAGESIZE);
+  if (((uintptr_t) target & (pagesize - 1)) != 0) {
+      return 0;
+  }
+  
+  mapsize = (gridsize + pagesize - 1) / pagesize * pagesize;
+  for (gridid = 0; gridid < allocgridcount; gridid++) {
+      if (target >= allocgridbase[gridid] && target + mapsize <= allocgridbase[gridid] + allocgridsize[gridid]) {
+          return 1;
+      }
+  }
+  
+  return 0;
+
+}
+
 int createallgrids() {
 
-  int pftid, cftid;
+  int pftid, cftid, croptype, stateid;
+  long ctsmlin, ctsmpix;
 
-  tempGrid = (float *) malloc(OUTDATASIZE);
-  tempoutGrid = (float *) malloc(OUTDATASIZE);
-  tempflipGrid = (float *) malloc(OUTDATASIZE);
-  tempextrapGrid = (float *) malloc(OUTDATASIZE);
-  secdfCROPINGrid = (float *) malloc(OUTDATASIZE);
-  secdfOTHERINGrid = (float *) malloc(OUTDATASIZE);
-  secdfOTHEROUTGrid = (float *) malloc(OUTDATASIZE);
-  secdnCROPINGrid = (float *) malloc(OUTDATASIZE);
-  secdnOTHERINGrid = (float *) malloc(OUTDATASIZE);
-  secdnOTHEROUTGrid = (float *) malloc(OUTDATASIZE);
+  tempGrid = (float *) allocgrid(OUTDATASIZE);
+  tempoutGrid = (float *) allocgrid(OUTDATASIZE);
+  secdfCROPINGrid = (float *) allocgrid(OUTDATASIZE);
+  secdfOTHERINGrid = (float *) allocgrid(OUTDATASIZE);
+  secdfOTHEROUTGrid = (float *) allocgrid(OUTDATASIZE);
+  secdnCROPINGrid = (float *) allocgrid(OUTDATASIZE);
+  secdnOTHERINGrid = (float *) allocgrid(OUTDATASIZE);
+  secdnOTHEROUTGrid = (float *) allocgrid(OUTDATASIZE);
+
+  for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+      tempextrapGrid[croptype] = (float *) allocgrid(OUTDATASIZE);
+      extrapCROPGrid[croptype] = (float *) allocgrid(OUTDATASIZE);
+      extrapFERTGrid[croptype] = (float *) allocgrid(OUTDATASIZE);
+  }
+  extrapCHANGEGrid = (char *) malloc(MAXOUTPIX * MAXOUTLIN * sizeof(char));
+  extrapCHANGESUMGrid = (int *) malloc((MAXOUTPIX + 1) * (MAXOUTLIN + 1) * sizeof(int));
+  extrapheatlin = (MAXOUTLIN + EXTRAPHEATBLOCK - 1) / EXTRAPHEATBLOCK;
+  extrapheatpix = (MAXOUTPIX + EXTRAPHEATBLOCK - 1) / EXTRAPHEATBLOCK;
+  extrapHEATGrid = (long *) malloc(extrapheatlin * extrapheatpix * sizeof(long));
+  landtilelin = (MAXOUTLIN + LANDTILESIZE - 1) / LANDTILESIZE;
+  landtilepix = (MAXOUTPIX + LANDTILESIZE - 1) / LANDTILESIZE;
+  landtileGrid = (char *) malloc(landtilelin * landtilepix * sizeof(char));
+  
+  /* Half the slice cache budget is left to blocks of the state and management variables */
+  
+  blockreadyears = slicecachebudget / (2L * BLOCKREADVARS * OUTDATASIZE);
+  if (blockreadyears < 1) {
+      blockreadyears = 1;
+  }
+  if (blockreadyears > MAXSLICECACHE / (2 * BLOCKREADVARS)) {
+      blockreadyears = MAXSLICECACHE / (2 * BLOCKREADVARS);
+  }
+  blockreadGrid = (float *) allocgrid(blockreadyears * OUTDATASIZE);
+  printf("Reading LUH states and management in blocks of %d years\n",blockreadyears);
 
   innatpft = (int *) malloc(MAXPFT * sizeof(int));
   incft = (int *) malloc(MAXCFT * sizeof(int));
   inLAT = (float *) malloc(MAXOUTLIN * sizeof(float));
-  inLATIXY = (float *) malloc(OUTDATASIZE);
+  inLATIXY = (float *) allocgrid(OUTDATASIZE);
   inLON = (float *) malloc(MAXOUTPIX * sizeof(float));
-  inLONGXY = (float *) malloc(OUTDATASIZE);
-
-  inLANDMASKGrid = (float *) malloc(OUTDATASIZE);
-  inLANDFRACGrid = (float *) malloc(OUTDATASIZE);
-  inAREAGrid = (float *) malloc(OUTDATASIZE);
-  inPCTGLACIERGrid = (float *) malloc(OUTDATASIZE);
-  inPCTLAKEGrid = (float *) malloc(OUTDATASIZE);
-  inPCTWETLANDGrid = (float *) malloc(OUTDATASIZE);
-  inPCTURBANGrid = (float *) malloc(OUTDATASIZE);
-  inPCTNATVEGGrid = (float *) malloc(OUTDATASIZE);
-  inPCTCROPGrid = (float *) malloc(OUTDATASIZE);
-  
+  inLONGXY = (float *) allocgrid(OUTDATASIZE);
+
+  inLANDMASKGrid = (float *) allocgrid(OUTDATASIZE);
+  inLANDFRACGrid = (float *) allocgrid(OUTDATASIZE);
+  inAREAGrid = (float *) allocgrid(OUTDATASIZE);
+  inPCTGLACIERGrid = (float *) allocgrid(OUTDATASIZE);
+  inPCTLAKEGrid = (float *) allocgrid(OUTDATASIZE);
+  inPCTWETLANDGrid = (float *) allocgrid(OUTDATASIZE);
+  inPCTURBANGrid = (float *) allocgrid(OUTDATASIZE);
+  inPCTNATVEGGrid = (float *) allocgrid(OUTDATASIZE);
+  inPCTCROPGrid = (float *) allocgrid(OUTDATASIZE);
+  
+  inCURRENTPCTPFTStack = (float *) allocgrid(MAXPFT * OUTDATASIZE);
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      inCURRENTPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+      inCURRENTPCTPFTGrid[pftid] = &inCURRENTPCTPFTStack[pftid * MAXOUTLIN * MAXOUTPIX];
   }
 
+  inCURRENTPCTCFTStack = (float *) allocgrid(MAXCFT * OUTDATASIZE);
   for (cftid = 0; cftid < MAXCFT; cftid++) {  
-      inCURRENTPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
+      inCURRENTPCTCFTGrid[cftid] = &inCURRENTPCTCFTStack[cftid * MAXOUTLIN * MAXOUTPIX];
   }
   
+  inFORESTPCTPFTStack = (float *) allocgrid(MAXPFT * OUTDATASIZE);
+  inPASTUREPCTPFTStack = (float *) allocgrid(MAXPFT * OUTDATASIZE);
+  inOTHERPCTPFTStack = (float *) allocgrid(MAXPFT * OUTDATASIZE);
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      inFORESTPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
-      inPASTUREPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
-      inOTHERPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+      inFORESTPCTPFTGrid[pftid] = &inFORESTPCTPFTStack[pftid * MAXOUTLIN * MAXOUTPIX];
+      inPASTUREPCTPFTGrid[pftid] = &inPASTUREPCTPFTStack[pftid * MAXOUTLIN * MAXOUTPIX];
+      inOTHERPCTPFTGrid[pftid] = &inOTHERPCTPFTStack[pftid * MAXOUTLIN * MAXOUTPIX];
   }
   
+  inC3ANNPCTCFTStack = (float *) allocgrid(MAXCFTRAW * OUTDATASIZE);
+  inC4ANNPCTCFTStack = (float *) allocgrid(MAXCFTRAW * OUTDATASIZE);
+  inC3PERPCTCFTStack = (float *) allocgrid(MAXCFTRAW * OUTDATASIZE);
+  inC4PERPCTCFTStack = (float *) allocgrid(MAXCFTRAW * OUTDATASIZE);
+  inC3NFXPCTCFTStack = (float *) allocgrid(MAXCFTRAW * OUTDATASIZE);
   for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      inC3ANNPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC4ANNPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC3PERPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC4PERPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC3NFXPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-  }
-
-  inBASEPRIMFGrid = (float *) malloc(OUTDATASIZE);
-  inBASEPRIMNGrid = (float *) malloc(OUTDATASIZE);
-  inBASESECDFGrid = (float *) malloc(OUTDATASIZE);
-  inBASESECDNGrid = (float *) malloc(OUTDATASIZE);
-  inBASEPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inBASERANGEGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC3NFXGrid = (float *) malloc(OUTDATASIZE);
-  inBASEURBANGrid = (float *) malloc(OUTDATASIZE);
-
-  inCURRPRIMFGrid = (float *) malloc(OUTDATASIZE);
-  inCURRPRIMNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRSECDFGrid = (float *) malloc(OUTDATASIZE);
-  inCURRSECDNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inCURRRANGEGrid = (float *) malloc(OUTDATASIZE);
-  inCURRCropGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC3NFXGrid = (float *) malloc(OUTDATASIZE);
-  inCURRURBANGrid = (float *) malloc(OUTDATASIZE);
-
-  inPREVDELTASECDFGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTASECDNGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTAPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTARANGEGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTAC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTAC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTAC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTAC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inPREVDELTAC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inHARVESTVH1Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTVH2Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTSH1Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTSH2Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTSH3Grid = (float *) malloc(OUTDATASIZE);
-
-  inBIOHVH1Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHVH2Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHSH1Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHSH2Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHSH3Grid = (float *) malloc(OUTDATASIZE);
-
-  inUNREPSECDFGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPSECDNGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPRANGEGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inFERTC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inIRRIGC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inBASEFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASENONFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASECROPTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASEURBANTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASEMISSINGGrid = (float *) malloc(OUTDATASIZE);
-  inBASEOTHERGrid = (float *) malloc(OUTDATASIZE);
-  inBASENATVEGGrid = (float *) malloc(OUTDATASIZE);
-
-  inCURRFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRNONFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRCROPTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inPREVCROPTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRURBANTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRMISSINGGrid = (float *) malloc(OUTDATASIZE);
-  inCURROTHERGrid = (float *) malloc(OUTDATASIZE);
-  inCURRNATVEGGrid = (float *) malloc(OUTDATASIZE);
-
-  inUNREPFORESTGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPOTHERGrid = (float *) malloc(OUTDATASIZE);
-
-  outLANDMASKGrid = (float *) malloc(OUTDATASIZE);
-  outPCTURBANGrid = (float *) malloc(OUTDATASIZE);
-  outPCTNATVEGGrid = (float *) malloc(OUTDATASIZE);
-  outPCTCROPGrid = (float *) malloc(OUTDATASIZE);
+      inC3ANNPCTCFTGrid[cftid] = &inC3ANNPCTCFTStack[cftid * MAXOUTLIN * MAXOUTPIX];
+      inC4ANNPCTCFTGrid[cftid] = &inC4ANNPCTCFTStack[cftid * MAXOUTLIN * MAXOUTPIX];
+      inC3PERPCTCFTGrid[cftid] = &inC3PERPCTCFTStack[cftid * MAXOUTLIN * MAXOUTPIX];
+      inC4PERPCTCFTGrid[cftid] = &inC4PERPCTCFTStack[cftid * MAXOUTLIN * MAXOUTPIX];
+      inC3NFXPCTCFTGrid[cftid] = &inC3NFXPCTCFTStack[cftid * MAXOUTLIN * MAXOUTPIX];
+  }
+
+  inBASEPRIMFGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEPRIMNGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASESECDFGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASESECDNGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEPASTRGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASERANGEGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEC3ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEC4ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEC3PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEC4PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEC3NFXGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEURBANGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inCURRPRIMFGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRPRIMNGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRCropGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRURBANGrid = (float *) allocgrid(OUTDATASIZE);
+
+  for (stateid = 0; stateid < MAXSTATEWINDOW; stateid++) {
+      inSTATEWINDOWGrid[0][stateid] = (float *) allocgrid(OUTDATASIZE);
+      inSTATEWINDOWGrid[1][stateid] = (float *) allocgrid(OUTDATASIZE);
+      *statewindowcurrGrid[stateid] = inSTATEWINDOWGrid[statewindowcurrent][stateid];
+  }
+
+  inPREVDELTASECDFGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTASECDNGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTAPASTRGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTARANGEGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTAC3ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTAC4ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTAC3PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTAC4PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVDELTAC3NFXGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inHARVESTVH1Grid = (float *) allocgrid(OUTDATASIZE);
+  inHARVESTVH2Grid = (float *) allocgrid(OUTDATASIZE);
+  inHARVESTSH1Grid = (float *) allocgrid(OUTDATASIZE);
+  inHARVESTSH2Grid = (float *) allocgrid(OUTDATASIZE);
+  inHARVESTSH3Grid = (float *) allocgrid(OUTDATASIZE);
+
+  inBIOHVH1Grid = (float *) allocgrid(OUTDATASIZE);
+  inBIOHVH2Grid = (float *) allocgrid(OUTDATASIZE);
+  inBIOHSH1Grid = (float *) allocgrid(OUTDATASIZE);
+  inBIOHSH2Grid = (float *) allocgrid(OUTDATASIZE);
+  inBIOHSH3Grid = (float *) allocgrid(OUTDATASIZE);
+
+  inUNREPSECDFGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPSECDNGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPPASTRGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPRANGEGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPC3ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPC4ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPC3PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPC4PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPC3NFXGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inFERTC3ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inFERTC4ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inFERTC3PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inFERTC4PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inFERTC3NFXGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inIRRIGC3ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inIRRIGC4ANNGrid = (float *) allocgrid(OUTDATASIZE);
+  inIRRIGC3PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inIRRIGC4PERGrid = (float *) allocgrid(OUTDATASIZE);
+  inIRRIGC3NFXGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inBASEFORESTTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASENONFORESTTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASECROPTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEURBANTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEMISSINGGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASEOTHERGrid = (float *) allocgrid(OUTDATASIZE);
+  inBASENATVEGGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inCURRFORESTTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRNONFORESTTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRCROPTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inPREVCROPTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRURBANTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRMISSINGGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURROTHERGrid = (float *) allocgrid(OUTDATASIZE);
+  inCURRNATVEGGrid = (float *) allocgrid(OUTDATASIZE);
+
+  inUNREPFORESTGrid = (float *) allocgrid(OUTDATASIZE);
+  inUNREPOTHERGrid = (float *) allocgrid(OUTDATASIZE);
+
+  outLANDMASKGrid = (float *) allocgrid(OUTDATASIZE);
+  outPCTURBANGrid = (float *) allocgrid(OUTDATASIZE);
+  outPCTNATVEGGrid = (float *) allocgrid(OUTDATASIZE);
+  outPCTCROPGrid = (float *) allocgrid(OUTDATASIZE);
   
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+      outPCTPFTGrid[pftid] = (float *) allocgrid(OUTDATASIZE);
   }
   
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
+      outPCTCFTGrid[cftid] = (float *) allocgrid(OUTDATASIZE);
   }
   
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outUNREPPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+      outUNREPPFTGrid[pftid] = (float *) allocgrid(OUTDATASIZE);
   }
 
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outUNREPCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
+      outUNREPCFTGrid[cftid] = (float *) allocgrid(OUTDATASIZE);
   }
   
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outFERTNITROGrid[cftid] = (float *) malloc(OUTDATASIZE);
+      outFERTNITROGrid[cftid] = (float *) allocgrid(OUTDATASIZE);
   }
   
-  outHARVESTVH1Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTVH2Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTSH1Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTSH2Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTSH3Grid = (float *) malloc(OUTDATASIZE);
+  outHARVESTVH1Grid = (float *) allocgrid(OUTDATASIZE);
+  outHARVESTVH2Grid = (float *) allocgrid(OUTDATASIZE);
+  outHARVESTSH1Grid = (float *) allocgrid(OUTDATASIZE);
+  outHARVESTSH2Grid = (float *) allocgrid(OUTDATASIZE);
+  outHARVESTSH3Grid = (float *) allocgrid(OUTDATASIZE);
 
-  outBIOHVH1Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHVH2Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHSH1Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHSH2Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHSH3Grid = (float *) malloc(OUTDATASIZE);
+  outBIOHVH1Grid = (float *) allocgrid(OUTDATASIZE);
+  outBIOHVH2Grid = (float *) allocgrid(OUTDATASIZE);
+  outBIOHSH1Grid = (float *) allocgrid(OUTDATASIZE);
+  outBIOHSH2Grid = (float *) allocgrid(OUTDATASIZE);
+  outBIOHSH3Grid = (float *) allocgrid(OUTDATASIZE);
 
-  outRBIOHVH1Grid = (float *) malloc(OUTDATASIZE);
-  outRBIOHVH2Grid = (float *) malloc(OUTDATASIZE);
-  outRBIOHSH1Grid = (float *) malloc(OUTDATASIZE);
-  outRBIOHSH2Grid = (float *) malloc(OUTDATASIZE);
-  outRBIOHSH3Grid = (float *) malloc(OUTDATASIZE);
+  outRBIOHVH1Grid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHVH2Grid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHSH1Grid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHSH2Grid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHSH3Grid = (float *) allocgrid(OUTDATASIZE);
 
-  outRBIOHTreePFTAreaGrid = (float *) malloc(OUTDATASIZE);
-  outRBIOHTreePFTWeightedAreaGrid = (float *) malloc(OUTDATASIZE);
-  outRBIOHPFTAreaGrid = (float *) malloc(OUTDATASIZE);
-  outRBIOHORIGTOTALGrid = (float *) malloc(OUTDATASIZE);
-  outRBIOHCURRTOTALGrid = (float *) malloc(OUTDATASIZE);
+  outRBIOHTreePFTAreaGrid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHTreePFTWeightedAreaGrid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHPFTAreaGrid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHORIGTOTALGrid = (float *) allocgrid(OUTDATASIZE);
+  outRBIOHCURRTOTALGrid = (float *) allocgrid(OUTDATASIZE);
 
   outLANDFRACdblGrid = (double *) malloc(OUTDBLDATASIZE);
   outAREAdblGrid = (double *) malloc(OUTDBLDATASIZE);
@@ -712,24 +1149,34 @@ int createallgrids() {
   outPCTNATVEGdblGrid = (double *) malloc(OUTDBLDATASIZE);
   outPCTCROPdblGrid = (double *) malloc(OUTDBLDATASIZE);
   
+  outPCTPFTdblStack = (double *) malloc(MAXPFT * OUTDBLDATASIZE);
+  outPCTCFTdblStack = (double *) malloc(MAXCFT * OUTDBLDATASIZE);
+  outUNREPPFTdblStack = (double *) malloc(MAXPFT * OUTDBLDATASIZE);
+  outUNREPCFTdblStack = (double *) malloc(MAXCFT * OUTDBLDATASIZE);
+  outFERTNITROdblStack = (double *) malloc(MAXCFT * OUTDBLDATASIZE);
+  if (outPCTPFTdblStack == NULL || outPCTCFTdblStack == NULL || outUNREPPFTdblStack == NULL || outUNREPCFTdblStack == NULL || outFERTNITROdblStack == NULL) {
+      printf("Cannot allocate output stacks\n");
+      exit(1);
+  }
+  
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outPCTPFTdblGrid[pftid] = (double *) malloc(OUTDBLDATASIZE);
+      outPCTPFTdblGrid[pftid] = &outPCTPFTdblStack[pftid * MAXOUTLIN * MAXOUTPIX];
   }
   
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outPCTCFTdblGrid[cftid] = (double *) malloc(OUTDBLDATASIZE);
+      outPCTCFTdblGrid[cftid] = &outPCTCFTdblStack[cftid * MAXOUTLIN * MAXOUTPIX];
   }
   
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outUNREPPFTdblGrid[pftid] = (double *) malloc(OUTDBLDATASIZE);
+      outUNREPPFTdblGrid[pftid] = &outUNREPPFTdblStack[pftid * MAXOUTLIN * MAXOUTPIX];
   }
 
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outUNREPCFTdblGrid[cftid] = (double *) malloc(OUTDBLDATASIZE);
+      outUNREPCFTdblGrid[cftid] = &outUNREPCFTdblStack[cftid * MAXOUTLIN * MAXOUTPIX];
   }
   
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outFERTNITROdblGrid[cftid] = (double *) malloc(OUTDBLDATASIZE);
+      outFERTNITROdblGrid[cftid] = &outFERTNITROdblStack[cftid * MAXOUTLIN * MAXOUTPIX];
   }
   
   outRBIOHVH1dblGrid = (double *) malloc(OUTDBLDATASIZE);
@@ -737,6 +1184,15 @@ int createallgrids() {
   outRBIOHSH1dblGrid = (double *) malloc(OUTDBLDATASIZE);
   outRBIOHSH2dblGrid = (double *) malloc(OUTDBLDATASIZE);
   outRBIOHSH3dblGrid = (double *) malloc(OUTDBLDATASIZE);
+  
+  /* GRAZING is not generated, output files are not prefilled so it is written as its fill value */
+  
+  outGRAZINGdblGrid = (double *) malloc(OUTDBLDATASIZE);
+  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          outGRAZINGdblGrid[ctsmlin * MAXOUTPIX + ctsmpix] = -9999.0;
+      }
+  }
 
   return 0;
 
@@ -843,721 +1299,3108 @@ int initializeGrids() {
 }
 
 void
-check_err(const int stat, const int line, const char *file) {
+check_err(const int ncstat, const int line, const char *file) {
 
-    if (stat != NC_NOERR) {
-        (void)fprintf(stderr,"line %d of %s: %s\n", line, file, nc_strerror(stat));
+    if (ncstat != NC_NOERR) {
+        (void)fprintf(stderr,"line %d of %s: %s\n", line, file, nc_strerror(ncstat));
         fflush(stderr);
         exit(1);
     }
 }
 
 int
-openncinputfile(char *netcdffilename) {
-
-    printf("Opening NetCDF File: %s\n",netcdffilename); 
-    stat = nc_open(netcdffilename, NC_NOWRITE, &ncid);
-    check_err(stat,__LINE__,__FILE__);
-
+hashinputfile(char *netcdffilename, int fileindex) {
+
+    /* Identify an input by its size, modification time, inode and device and an FNV-1a */
+    /* hash of its first and last megabyte                                                */
+
+    FILE *hashfile;
+    struct stat filestat;
+    unsigned char *hashbuffer;
+    unsigned long hashvalue = 14695981039346656037UL;
+    long long filesize;
+    size_t hashbytes, byteid;
+    int pass;
+    
+    ncinputfilesize[fileindex] = -1;
+    ncinputfilehash[fileindex] = 0;
+    
+    hashfile = fopen(netcdffilename,"rb");
+    if (hashfile == NULL) {
+        return 1;
+    }
+    if (fstat(fileno(hashfile),&filestat) != 0) {
+        fclose(hashfile);
+        return 1;
+    }
+    hashbuffer = (unsigned char *) malloc(DISKCACHEHASHBYTES);
+    
+    filesize = filestat.st_size;
+    
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 0 || filesize > DISKCACHEHASHBYTES) {
+            fseeko(hashfile,pass == 0 ? 0 : filesize - DISKCACHEHASHBYTES,SEEK_SET);
+            hashbytes = fread(hashbuffer,1,DISKCACHEHASHBYTES,hashfile);
+            for (byteid = 0; byteid < hashbytes; byteid++) {
+                hashvalue = (hashvalue ^ hashbuffer[byteid]) * 1099511628211UL;
+            }
+        }
+    }
+    
+    free(hashbuffer);
+    fclose(hashfile);
+    
+    ncinputfilesize[fileindex] = filesize;
+    ncinputfilemtime[fileindex] = filestat.st_mtim.tv_sec * 1000000000LL + filestat.st_mtim.tv_nsec;
+    ncinputfileinode[fileindex] = filestat.st_ino;
+    ncinputfiledevice[fileindex] = filestat.st_dev;
+    ncinputfilehash[fileindex] = hashvalue;
+    
     return 0;
 
 }
 
-int
-openncoutputfile(char *netcdffilename) {
+long long
+classicheadervalue(int fileindex, long long *position, int bytes) {
 
-    printf("Opening NetCDF File: %s\n",netcdffilename); 
-    stat = nc_open(netcdffilename, NC_WRITE, &ncid);
-    check_err(stat,__LINE__,__FILE__);
+    /* Big endian header integer of 4 or 8 bytes, reading past the mapping marks the header bad */
 
-    return 0;
+    unsigned char *header = (unsigned char *) ncinputmap[fileindex];
+    long long value = 0;
+    int byteid;
+    
+    if (*position + bytes > ncinputmapsize[fileindex]) {
+        *position = ncinputmapsize[fileindex] + 1;
+        return -1;
+    }
+    
+    for (byteid = 0; byteid < bytes; byteid++) {
+        value = (value << 8) | header[*position + byteid];
+    }
+    *position += bytes;
+    
+    return value;
 
 }
 
 int
-createncoutputfile(char *netcdffilename) {
-
-    printf("Creating NetCDF File: %s\n",netcdffilename); 
+skipclassicattributes(int fileindex, long long *position, int nonnegbytes) {
 
-    /* enter define mode */
-    stat = nc_create(netcdffilename, NC_CLOBBER|NC_CDF5, &ncid);
-    check_err(stat,__LINE__,__FILE__);
+    long long attcount, attid, namelength, attlength;
+    int atttype, typebytes;
+    
+    classicheadervalue(fileindex,position,4);
+    attcount = classicheadervalue(fileindex,position,nonnegbytes);
+    
+    for (attid = 0; attid < attcount && *position <= ncinputmapsize[fileindex]; attid++) {
+        namelength = classicheadervalue(fileindex,position,nonnegbytes);
+        *position += (namelength + 3) / 4 * 4;
+        atttype = classicheadervalue(fileindex,position,4);
+        attlength = classicheadervalue(fileindex,position,nonnegbytes);
+        typebytes = 4;
+        if (atttype == NC_BYTE || atttype == NC_CHAR || atttype == NC_UBYTE) {
+            typebytes = 1;
+        }
+        if (atttype == NC_SHORT || atttype == NC_USHORT) {
+            typebytes = 2;
+        }
+        if (atttype == NC_DOUBLE || atttype == NC_INT64 || atttype == NC_UINT64) {
+            typebytes = 8;
+        }
+        *position += (attlength * typebytes + 3) / 4 * 4;
+    }
+    
+    return 0;
 
-    /* define dimensions */
-    stat = nc_def_dim(ncid, "natpft", natpft_len, &natpft_dim);
-    check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "cft", cft_len, &cft_dim);
-    check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "lon", lon_len, &lon_dim);
-    check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "lat", lat_len, &lat_dim);
-    check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "nchar", nchar_len, &nchar_dim);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    /* define variables */
+int
+scanclassicheader(int fileindex, char *FieldName, long long *varbegin, int *varrecord) {
 
-    natpft_dims[0] = natpft_dim;
-    stat = nc_def_var(ncid, "natpft", NC_INT, RANK_natpft, natpft_dims, &natpft_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* Walk the classic header, summing the record size, and find the begin offset of FieldName */
+    /* when it is a float variable. Returns 1 when found, 0 when not and -1 on a bad header.     */
 
-    cft_dims[0] = cft_dim;
-    stat = nc_def_var(ncid, "cft", NC_INT, RANK_cft, cft_dims, &cft_id);
-    check_err(stat,__LINE__,__FILE__);
+    long long position, dimcount, dimid, varcount, varid, namelength, dimlength, recorddim, firstdim, vardims, vardimid, varsize, begin, recsize;
+    int nonnegbytes, offsetbytes, vartype, namematch, found;
+    
+    nonnegbytes = 4;
+    offsetbytes = 8;
+    if (ncinputformat[fileindex] == 5) {
+        nonnegbytes = 8;
+    }
+    if (ncinputformat[fileindex] == 1) {
+        offsetbytes = 4;
+    }
+    
+    position = 4;
+    classicheadervalue(fileindex,&position,nonnegbytes);
+    
+    classicheadervalue(fileindex,&position,4);
+    dimcount = classicheadervalue(fileindex,&position,nonnegbytes);
+    recorddim = -1;
+    for (dimid = 0; dimid < dimcount && position <= ncinputmapsize[fileindex]; dimid++) {
+        namelength = classicheadervalue(fileindex,&position,nonnegbytes);
+        position += (namelength + 3) / 4 * 4;
+        dimlength = classicheadervalue(fileindex,&position,nonnegbytes);
+        if (dimlength == 0) {
+            recorddim = dimid;
+        }
+    }
+    
+    skipclassicattributes(fileindex,&position,nonnegbytes);
+    
+    classicheadervalue(fileindex,&position,4);
+    varcount = classicheadervalue(fileindex,&position,nonnegbytes);
+    recsize = 0;
+    found = 0;
+    for (varid = 0; varid < varcount && position <= ncinputmapsize[fileindex]; varid++) {
+        namelength = classicheadervalue(fileindex,&position,nonnegbytes);
+        if (position + namelength > ncinputmapsize[fileindex]) {
+            return -1;
+        }
+        namematch = 0;
+        if (FieldName != NULL && namelength == strlen(FieldName) && strncmp(&ncinputmap[fileindex][position],FieldName,namelength) == 0) {
+            namematch = 1;
+        }
+        position += (namelength + 3) / 4 * 4;
+        vardims = classicheadervalue(fileindex,&position,nonnegbytes);
+        firstdim = -1;
+        for (vardimid = 0; vardimid < vardims && position <= ncinputmapsize[fileindex]; vardimid++) {
+            dimid = classicheadervalue(fileindex,&position,nonnegbytes);
+            if (vardimid == 0) {
+                firstdim = dimid;
+            }
+        }
+        skipclassicattributes(fileindex,&position,nonnegbytes);
+        vartype = classicheadervalue(fileindex,&position,4);
+        varsize = classicheadervalue(fileindex,&position,nonnegbytes);
+        begin = classicheadervalue(fileindex,&position,offsetbytes);
+        if (vardims > 0 && firstdim == recorddim) {
+            recsize += varsize;
+        }
+        if (namematch == 1 && vartype == NC_FLOAT) {
+            *varbegin = begin;
+            *varrecord = (vardims > 0 && firstdim == recorddim);
+            found = 1;
+        }
+    }
+    
+    if (position > ncinputmapsize[fileindex]) {
+        return -1;
+    }
+    
+    ncinputrecsize[fileindex] = recsize;
+    
+    return found;
 
-    stat = nc_def_var(ncid, "EDGEN", NC_FLOAT, RANK_EDGEN, 0, &EDGEN_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    stat = nc_def_var(ncid, "EDGEE", NC_FLOAT, RANK_EDGEE, 0, &EDGEE_id);
-    check_err(stat,__LINE__,__FILE__);
+int
+mapclassicfile(char *netcdffilename, int fileindex) {
 
-    stat = nc_def_var(ncid, "EDGES", NC_FLOAT, RANK_EDGES, 0, &EDGES_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* Map classic, 64 bit offset and CDF5 files read only, NetCDF-4 files are left to the library */
 
-    stat = nc_def_var(ncid, "EDGEW", NC_FLOAT, RANK_EDGEW, 0, &EDGEW_id);
-    check_err(stat,__LINE__,__FILE__);
+    unsigned char magic[4];
+    long long varbegin;
+    int mapfile, varrecord;
+    
+    ncinputformat[fileindex] = 0;
+    ncinputmap[fileindex] = NULL;
+    ncinputmapfile[fileindex] = -1;
+    ncinputmapsize[fileindex] = 0;
+    
+    mapfile = open(netcdffilename,O_RDONLY);
+    if (mapfile < 0) {
+        return 1;
+    }
+    ncinputmapsize[fileindex] = lseek(mapfile,0,SEEK_END);
+    
+    if (ncinputmapsize[fileindex] > 8 && pread(mapfile,magic,4,0) == 4) {
+        if (magic[0] == 'C' && magic[1] == 'D' && magic[2] == 'F' && (magic[3] == 1 || magic[3] == 2 || magic[3] == 5)) {
+            ncinputmap[fileindex] = (char *) mmap(NULL,ncinputmapsize[fileindex],PROT_READ,MAP_SHARED,mapfile,0);
+            if (ncinputmap[fileindex] == MAP_FAILED) {
+                ncinputmap[fileindex] = NULL;
+            }
+            else {
+                ncinputformat[fileindex] = magic[3];
+            }
+        }
+    }
+    
+    /* The descriptor stays open for page cache advice on mapped files */
+    
+    if (ncinputmap[fileindex] == NULL) {
+        close(mapfile);
+    }
+    else {
+        ncinputmapfile[fileindex] = mapfile;
+    }
+    
+    if (ncinputmap[fileindex] != NULL && scanclassicheader(fileindex,NULL,&varbegin,&varrecord) < 0) {
+        printf("Classic header not understood, reading through NetCDF: %s\n",netcdffilename);
+        munmap(ncinputmap[fileindex],ncinputmapsize[fileindex]);
+        close(ncinputmapfile[fileindex]);
+        ncinputmap[fileindex] = NULL;
+        ncinputmapfile[fileindex] = -1;
+        ncinputformat[fileindex] = 0;
+    }
+    
+    return 0;
 
-    LAT_dims[0] = lat_dim;
-    stat = nc_def_var(ncid, "LAT", NC_FLOAT, RANK_LAT, LAT_dims, &LAT_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    LATIXY_dims[0] = lat_dim;
-    LATIXY_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LATIXY", NC_FLOAT, RANK_LATIXY, LATIXY_dims, &LATIXY_id);
-    check_err(stat,__LINE__,__FILE__);
+int
+openh5chunkfile(char *netcdffilename, int fileindex) {
 
-    LON_dims[0] = lon_dim;
-    stat = nc_def_var(ncid, "LON", NC_FLOAT, RANK_LON, LON_dims, &LON_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* NetCDF-4 files are HDF5 files, open them a second time for direct chunk reads */
 
-    LONGXY_dims[0] = lat_dim;
-    LONGXY_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LONGXY", NC_FLOAT, RANK_LONGXY, LONGXY_dims, &LONGXY_id);
-    check_err(stat,__LINE__,__FILE__);
+    ncinputh5file[fileindex] = -1;
+    
+    if (ncinputmap[fileindex] != NULL) {
+        return 0;
+    }
+    
+    H5Eset_auto2(H5E_DEFAULT,NULL,NULL);
+    if (H5Fis_hdf5(netcdffilename) > 0) {
+        ncinputh5file[fileindex] = H5Fopen(netcdffilename,H5F_ACC_RDONLY,H5P_DEFAULT);
+    }
+    
+    return 0;
 
-    LANDMASK_dims[0] = lat_dim;
-    LANDMASK_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LANDMASK", NC_FLOAT, RANK_LANDMASK, LANDMASK_dims, &LANDMASK_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    LANDFRAC_dims[0] = lat_dim;
-    LANDFRAC_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LANDFRAC", NC_DOUBLE, RANK_LANDFRAC, LANDFRAC_dims, &LANDFRAC_id);
-    check_err(stat,__LINE__,__FILE__);
+int
+openh5chunkvar(int fileindex, int varindex, char *FieldName) {
 
-    AREA_dims[0] = lat_dim;
-    AREA_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "AREA", NC_DOUBLE, RANK_AREA, AREA_dims, &AREA_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* Only chunked 32 bit float datasets without filters other than shuffle and deflate are read raw */
 
-    PCT_GLACIER_dims[0] = lat_dim;
-    PCT_GLACIER_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_GLACIER", NC_DOUBLE, RANK_PCT_GLACIER, PCT_GLACIER_dims, &PCT_GLACIER_id);
-    check_err(stat,__LINE__,__FILE__);
+    hid_t h5var, h5type, h5plist, h5space;
+    hsize_t h5dims[MAXNCVARDIMS];
+    unsigned int filterflags, filterconfig;
+    size_t filterelements;
+    int filterid, filterindex, dimindex, usable;
+    
+    ncinputvarh5[fileindex][varindex] = -1;
+    
+    if (ncinputh5file[fileindex] < 0 || ncinputvarndims[fileindex][varindex] > MAXNCVARDIMS) {
+        return 0;
+    }
+    h5var = H5Dopen2(ncinputh5file[fileindex],FieldName,H5P_DEFAULT);
+    if (h5var < 0) {
+        return 0;
+    }
+    
+    h5type = H5Dget_type(h5var);
+    h5plist = H5Dget_create_plist(h5var);
+    usable = (H5Tget_class(h5type) == H5T_FLOAT && H5Tget_size(h5type) == sizeof(float));
+    usable = usable && H5Pget_layout(h5plist) == H5D_CHUNKED;
+    usable = usable && H5Pget_chunk(h5plist,MAXNCVARDIMS,ncinputvarh5chunk[fileindex][varindex]) == ncinputvarndims[fileindex][varindex];
+    
+    ncinputvarshuffle[fileindex][varindex] = 0;
+    ncinputvardeflate[fileindex][varindex] = 0;
+    for (filterindex = 0; usable && filterindex < H5Pget_nfilters(h5plist); filterindex++) {
+        filterelements = 0;
+        filterid = H5Pget_filter2(h5plist,filterindex,&filterflags,&filterelements,NULL,0,NULL,&filterconfig);
+        if (filterid == H5Z_FILTER_SHUFFLE && filterindex == 0) {
+            ncinputvarshuffle[fileindex][varindex] = 1;
+        }
+        else if (filterid == H5Z_FILTER_DEFLATE && ncinputvardeflate[fileindex][varindex] == 0) {
+            ncinputvardeflate[fileindex][varindex] = 1;
+        }
+        else {
+            usable = 0;
+        }
+    }
+    
+    if (usable) {
+        h5space = H5Dget_space(h5var);
+        H5Sget_simple_extent_dims(h5space,h5dims,NULL);
+        H5Sclose(h5space);
+        for (dimindex = 0; dimindex < ncinputvarndims[fileindex][varindex]; dimindex++) {
+            usable = usable && h5dims[dimindex] == ncinputvardimlen[fileindex][varindex][dimindex];
+        }
+    }
+    
+    ncinputvarswap[fileindex][varindex] = (H5Tget_order(h5type) != H5Tget_order(H5T_NATIVE_FLOAT));
+    H5Tclose(h5type);
+    H5Pclose(h5plist);
+    
+    if (usable) {
+        ncinputvarh5[fileindex][varindex] = h5var;
+    }
+    else {
+        H5Dclose(h5var);
+    }
+    
+    return 0;
 
-    PCT_LAKE_dims[0] = lat_dim;
-    PCT_LAKE_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_LAKE", NC_DOUBLE, RANK_PCT_LAKE, PCT_LAKE_dims, &PCT_LAKE_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    PCT_WETLAND_dims[0] = lat_dim;
-    PCT_WETLAND_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_WETLAND", NC_DOUBLE, RANK_PCT_WETLAND, PCT_WETLAND_dims, &PCT_WETLAND_id);
-    check_err(stat,__LINE__,__FILE__);
+char *
+zarrjsonvalue(char *json, char *key) {
 
-    PCT_URBAN_dims[0] = lat_dim;
-    PCT_URBAN_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_URBAN", NC_DOUBLE, RANK_PCT_URBAN, PCT_URBAN_dims, &PCT_URBAN_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* Start of the value following "key": in a metadata document, NULL when the key is absent */
 
-    PCT_NATVEG_dims[0] = lat_dim;
-    PCT_NATVEG_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_NATVEG", NC_DOUBLE, RANK_PCT_NATVEG, PCT_NATVEG_dims, &PCT_NATVEG_id);
-    check_err(stat,__LINE__,__FILE__);
+    char quotedkey[NC_MAX_NAME+3];
+    char *value;
+    
+    sprintf(quotedkey,"\"%s\"",key);
+    value = strstr(json,quotedkey);
+    if (value == NULL) {
+        return NULL;
+    }
+    value += strlen(quotedkey);
+    while (isspace(*value) || *value == ':') {
+        value++;
+    }
+    
+    return value;
 
-    PCT_CROP_dims[0] = lat_dim;
-    PCT_CROP_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_CROP", NC_DOUBLE, RANK_PCT_CROP, PCT_CROP_dims, &PCT_CROP_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    PCT_NAT_PFT_dims[0] = natpft_dim;
-    PCT_NAT_PFT_dims[1] = lat_dim;
-    PCT_NAT_PFT_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_NAT_PFT", NC_DOUBLE, RANK_PCT_NAT_PFT, PCT_NAT_PFT_dims, &PCT_NAT_PFT_id);
-    check_err(stat,__LINE__,__FILE__);
+int
+zarrjsontext(char *value, char *target, int maxlength) {
 
-    PCT_CFT_dims[0] = cft_dim;
-    PCT_CFT_dims[1] = lat_dim;
-    PCT_CFT_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_CFT", NC_DOUBLE, RANK_PCT_CFT, PCT_CFT_dims, &PCT_CFT_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* Copy a quoted string value, returns 0 when the value is not a string */
 
-    FERTNITRO_CFT_dims[0] = cft_dim;
-    FERTNITRO_CFT_dims[1] = lat_dim;
-    FERTNITRO_CFT_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "FERTNITRO_CFT", NC_DOUBLE, RANK_FERTNITRO_CFT, FERTNITRO_CFT_dims, &FERTNITRO_CFT_id);
-    check_err(stat,__LINE__,__FILE__);
+    int length;
+    
+    target[0] = '\0';
+    if (value == NULL || *value != '"') {
+        return 0;
+    }
+    value++;
+    for (length = 0; value[length] != '"' && value[length] != '\0' && length < maxlength - 1; length++) {
+        target[length] = value[length];
+    }
+    target[length] = '\0';
+    
+    return 1;
 
-    HARVEST_VH1_dims[0] = lat_dim;
-    HARVEST_VH1_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_VH1", NC_DOUBLE, RANK_HARVEST_VH1, HARVEST_VH1_dims, &HARVEST_VH1_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    HARVEST_VH2_dims[0] = lat_dim;
-    HARVEST_VH2_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_VH2", NC_DOUBLE, RANK_HARVEST_VH2, HARVEST_VH2_dims, &HARVEST_VH2_id);
-    check_err(stat,__LINE__,__FILE__);
+int
+zarrjsonstring(char *json, char *key, char *target, int maxlength) {
 
-    HARVEST_SH1_dims[0] = lat_dim;
-    HARVEST_SH1_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_SH1", NC_DOUBLE, RANK_HARVEST_SH1, HARVEST_SH1_dims, &HARVEST_SH1_id);
-    check_err(stat,__LINE__,__FILE__);
+    return zarrjsontext(zarrjsonvalue(json,key),target,maxlength);
 
-    HARVEST_SH2_dims[0] = lat_dim;
-    HARVEST_SH2_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_SH2", NC_DOUBLE, RANK_HARVEST_SH2, HARVEST_SH2_dims, &HARVEST_SH2_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    HARVEST_SH3_dims[0] = lat_dim;
-    HARVEST_SH3_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_SH3", NC_DOUBLE, RANK_HARVEST_SH3, HARVEST_SH3_dims, &HARVEST_SH3_id);
-    check_err(stat,__LINE__,__FILE__);
+int
+zarrjsonlist(char *json, char *key, size_t *target, int maxvalues) {
 
-    GRAZING_dims[0] = lat_dim;
-    GRAZING_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "GRAZING", NC_DOUBLE, RANK_GRAZING, GRAZING_dims, &GRAZING_id);
-    check_err(stat,__LINE__,__FILE__);
+    /* Integers of a [a, b, ...] list, returns how many were read or -1 when there is no list */
 
-    UNREPRESENTED_PFT_LULCC_dims[0] = natpft_dim;
-    UNREPRESENTED_PFT_LULCC_dims[1] = lat_dim;
-    UNREPRESENTED_PFT_LULCC_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "UNREPRESENTED_PFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_PFT_LULCC, UNREPRESENTED_PFT_LULCC_dims, &UNREPRESENTED_PFT_LULCC_id);
-    check_err(stat,__LINE__,__FILE__);
+    char *value, *endvalue;
+    int nvalues;
+    
+    value = zarrjsonvalue(json,key);
+    if (value == NULL || *value != '[') {
+        return -1;
+    }
+    value++;
+    
+    nvalues = 0;
+    while (nvalues <= maxvalues) {
+        while (isspace(*value) || *value == ',') {
+            value++;
+        }
+        if (*value == ']') {
+            return nvalues;
+        }
+        if (nvalues == maxvalues) {
+            return -1;
+        }
+        target[nvalues] = strtoul(value,&endvalue,10);
+        if (endvalue == value) {
+            return -1;
+        }
+        value = endvalue;
+        nvalues++;
+    }
+    
+    return -1;
 
-    UNREPRESENTED_CFT_LULCC_dims[0] = cft_dim;
-    UNREPRESENTED_CFT_LULCC_dims[1] = lat_dim;
-    UNREPRESENTED_CFT_LULCC_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "UNREPRESENTED_CFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_CFT_LULCC, UNREPRESENTED_CFT_LULCC_dims, &UNREPRESENTED_CFT_LULCC_id);
-    check_err(stat,__LINE__,__FILE__);
+}
 
-    /* assign global attributes */
+int
+readzarrmeta(char *metafilename, char *json) {
 
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "Conventions", 8, "NCAR-CSM");
-    check_err(stat,__LINE__,__FILE__);
+    FILE *metafile;
+    size_t metabytes;
+    
+    metafile = fopen(metafilename,"rb");
+    if (metafile == NULL) {
+        return 0;
     }
+    metabytes = fread(json,1,ZARRMETABYTES - 1,metafile);
+    fclose(metafile);
+    json[metabytes] = '\0';
+    
+    return 1;
 
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "Author", strlen(authorname), authorname);
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "History_Log", strlen(timestamp), timestamp);
-    check_err(stat,__LINE__,__FILE__);
-    }
-    
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "Region", strlen(regionfilename), regionfilename);
-    check_err(stat,__LINE__,__FILE__);
-    }
+int
+zarrstoreversion(char *storename) {
+
+    /* 3 for a directory holding zarr.json, 2 for one holding Zarr v2 metadata, otherwise 0 */
+
+    char metafilename[PATH_MAX+32];
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMCurrentDB", strlen(ctsmcurrentsurfdb), ctsmcurrentsurfdb);
-    check_err(stat,__LINE__,__FILE__);
+    sprintf(metafilename,"%s/zarr.json",storename);
+    if (access(metafilename,R_OK) == 0) {
+        return 3;
     }
-    
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMForestDB", strlen(ctsmLUHforestdb), ctsmLUHforestdb);
-    check_err(stat,__LINE__,__FILE__);
+    sprintf(metafilename,"%s/.zgroup",storename);
+    if (access(metafilename,R_OK) == 0) {
+        return 2;
     }
-    
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMPastureDB", strlen(ctsmLUHpasturedb), ctsmLUHpasturedb);
-    check_err(stat,__LINE__,__FILE__);
+    sprintf(metafilename,"%s/.zarray",storename);
+    if (access(metafilename,R_OK) == 0) {
+        return 2;
     }
     
+    return 0;
+
+}
+
+int
+openzarrvar(int fileindex, int varindex, char *FieldName) {
+
+    /* Shape, chunking, type, codec and chunk key layout of a Zarr array of 4 or 8 byte floats. */
+    /* Anything else (filters, F order, sharding, transposes) stops the run with a message.    */
+
+    char metafilename[PATH_MAX+NC_MAX_NAME+32], json[ZARRMETABYTES], codecs[ZARRMETABYTES];
+    char typename[64], codecname[64], endianname[64], keyname[64], *value;
+    size_t shape[MAXNCVARDIMS], chunks[MAXNCVARDIMS];
+    int ndims, nchunkdims, dimindex, depth, codecindex, bigendian, usable;
+    
+    ncinputvarzarrcodec[fileindex][varindex] = ZARRRAW;
+    ncinputvarzarrbytes[fileindex][varindex] = 0;
+    ncinputvarzarrseparator[fileindex][varindex] = '.';
+    ncinputvarzarrprefix[fileindex][varindex] = 0;
+    bigendian = 0;
+    usable = 1;
+    
+    sprintf(metafilename,"%s/%s/zarr.json",ncinputfilename[fileindex],FieldName);
+    if (readzarrmeta(metafilename,json) == 1) {
+        ndims = zarrjsonlist(json,"shape",shape,MAXNCVARDIMS);
+        nchunkdims = zarrjsonlist(json,"chunk_shape",chunks,MAXNCVARDIMS);
+        zarrjsonstring(json,"data_type",typename,64);
+        if (strcmp(typename,"float32") == 0) {
+            ncinputvarzarrbytes[fileindex][varindex] = 4;
+        }
+        if (strcmp(typename,"float64") == 0) {
+            ncinputvarzarrbytes[fileindex][varindex] = 8;
+        }
+        value = zarrjsonvalue(json,"chunk_key_encoding");
+        if (value != NULL && zarrjsonstring(value,"name",keyname,64) == 1 && strcmp(keyname,"v2") == 0) {
+            ncinputvarzarrseparator[fileindex][varindex] = '.';
+        }
+        else {
+            ncinputvarzarrseparator[fileindex][varindex] = '/';
+            ncinputvarzarrprefix[fileindex][varindex] = 1;
+        }
+        if (value != NULL && zarrjsonstring(value,"separator",keyname,64) == 1) {
+            ncinputvarzarrseparator[fileindex][varindex] = keyname[0];
+        }
+        
+        /* Codecs run bytes first then at most one compressor, only the list itself is searched */
+        
+        value = zarrjsonvalue(json,"codecs");
+        if (value == NULL || *value != '[') {
+            usable = 0;
+        }
+        else {
+            depth = 0;
+            codecindex = 0;
+            do {
+                if (*value == '[' || *value == '{') {
+                    depth++;
+                }
+                if (*value == ']' || *value == '}') {
+                    depth--;
+                }
+                codecs[codecindex++] = *value++;
+            } while (depth > 0 && *value != '\0');
+            codecs[codecindex] = '\0';
+            value = codecs;
+            while ((value = zarrjsonvalue(value,"name")) != NULL) {
+                zarrjsontext(value,codecname,64);
+                if (strcmp(codecname,"bytes") == 0) {
+                    if (zarrjsonstring(value,"endian",endianname,64) == 1 && strcmp(endianname,"big") == 0) {
+                        bigendian = 1;
+                    }
+                }
+                else if (strcmp(codecname,"gzip") == 0 || strcmp(codecname,"zlib") == 0 || strcmp(codecname,"numcodecs.zlib") == 0) {
+                    ncinputvarzarrcodec[fileindex][varindex] = ZARRZLIB;
+                }
+                else if (strcmp(codecname,"zstd") == 0) {
+                    ncinputvarzarrcodec[fileindex][varindex] = ZARRZSTD;
+                }
+                else if (strcmp(codecname,"blosc") == 0) {
+                    ncinputvarzarrcodec[fileindex][varindex] = ZARRBLOSC;
+                }
+                else {
+                    usable = 0;
+                }
+            }
+        }
+    }
+    else {
+        sprintf(metafilename,"%s/%s/.zarray",ncinputfilename[fileindex],FieldName);
+        if (readzarrmeta(metafilename,json) == 0) {
+            printf("Zarr array %s not found in %s\n",FieldName,ncinputfilename[fileindex]);
+            exit(1);
+        }
+        ndims = zarrjsonlist(json,"shape",shape,MAXNCVARDIMS);
+        nchunkdims = zarrjsonlist(json,"chunks",chunks,MAXNCVARDIMS);
+        zarrjsonstring(json,"dtype",typename,64);
+        if (typename[1] == 'f' && (typename[2] == '4' || typename[2] == '8') && typename[3] == '\0') {
+            ncinputvarzarrbytes[fileindex][varindex] = typename[2] - '0';
+            bigendian = (typename[0] == '>');
+        }
+        if (zarrjsonstring(json,"dimension_separator",keyname,64) == 1) {
+            ncinputvarzarrseparator[fileindex][varindex] = keyname[0];
+        }
+        if (zarrjsonstring(json,"order",keyname,64) == 0 || strcmp(keyname,"C") != 0) {
+            usable = 0;
+        }
+        value = zarrjsonvalue(json,"filters");
+        if (value != NULL && strncmp(value,"null",4) != 0 && strncmp(value,"[]",2) != 0) {
+            usable = 0;
+        }
+        value = zarrjsonvalue(json,"compressor");
+        if (value != NULL && strncmp(value,"null",4) != 0) {
+            zarrjsonstring(value,"id",codecname,64);
+            if (strcmp(codecname,"zlib") == 0 || strcmp(codecname,"gzip") == 0) {
+                ncinputvarzarrcodec[fileindex][varindex] = ZARRZLIB;
+            }
+            else if (strcmp(codecname,"zstd") == 0) {
+                ncinputvarzarrcodec[fileindex][varindex] = ZARRZSTD;
+            }
+            else if (strcmp(codecname,"blosc") == 0) {
+                ncinputvarzarrcodec[fileindex][varindex] = ZARRBLOSC;
+            }
+            else {
+                usable = 0;
+            }
+        }
+    }
+    
+#ifndef HAVE_ZSTD
+    if (ncinputvarzarrcodec[fileindex][varindex] == ZARRZSTD) {
+        printf("Zarr array %s in %s is zstd compressed, rebuild with -DHAVE_ZSTD -lzstd\n",FieldName,ncinputfilename[fileindex]);
+        exit(1);
+    }
+#endif
+#ifndef HAVE_BLOSC
+    if (ncinputvarzarrcodec[fileindex][varindex] == ZARRBLOSC) {
+        printf("Zarr array %s in %s is blosc compressed, rebuild with -DHAVE_BLOSC -lblosc\n",FieldName,ncinputfilename[fileindex]);
+        exit(1);
+    }
+#endif
+
+    usable = usable && ncinputvarzarrbytes[fileindex][varindex] > 0 && ndims >= 0 && ndims == nchunkdims;
+    if (usable == 0) {
+        printf("Zarr array %s in %s is not a plain C order float array\n",FieldName,ncinputfilename[fileindex]);
+        exit(1);
+    }
+    
+    /* The fill value of chunks that were never written, NaN and null both read as given by CF */
+    
+    value = zarrjsonvalue(json,"fill_value");
+    ncinputvarzarrfill[fileindex][varindex] = 0.0;
+    if (value != NULL && *value == '"') {
+        if (strncmp(value,"\"NaN\"",5) == 0) {
+            ncinputvarzarrfill[fileindex][varindex] = NAN;
+        }
+        if (strncmp(value,"\"Infinity\"",10) == 0) {
+            ncinputvarzarrfill[fileindex][varindex] = INFINITY;
+        }
+        if (strncmp(value,"\"-Infinity\"",11) == 0) {
+            ncinputvarzarrfill[fileindex][varindex] = -INFINITY;
+        }
+    }
+    else if (value != NULL && strncmp(value,"null",4) != 0) {
+        ncinputvarzarrfill[fileindex][varindex] = strtod(value,NULL);
+    }
+    
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    ncinputvarswap[fileindex][varindex] = (bigendian == 0);
+#else
+    ncinputvarswap[fileindex][varindex] = bigendian;
+#endif
+
+    ncinputvarndims[fileindex][varindex] = ndims;
+    for (dimindex = 0; dimindex < MAXNCVARDIMS; dimindex++) {
+        ncinputvardimlen[fileindex][varindex][dimindex] = 1;
+        ncinputvarchunk[fileindex][varindex][dimindex] = 1;
+        ncinputvarh5chunk[fileindex][varindex][dimindex] = 1;
+        if (dimindex < ndims) {
+            ncinputvardimlen[fileindex][varindex][dimindex] = shape[dimindex];
+            ncinputvarchunk[fileindex][varindex][dimindex] = chunks[dimindex];
+            ncinputvarh5chunk[fileindex][varindex][dimindex] = chunks[dimindex];
+        }
+    }
+    
+    return 0;
+
+}
+
+int
+openncinputfile(char *netcdffilename) {
+
+    char canonicalname[PATH_MAX];
+    int fileindex, zarrversion;
+
+    if (realpath(netcdffilename,canonicalname) == NULL) {
+        sprintf(canonicalname,"%s",netcdffilename);
+    }
+    
+    for (fileindex = 0; fileindex < ncinputfilecount; fileindex++) {
+        if (strcmp(ncinputfilename[fileindex],canonicalname) == 0) {
+            ncinputfileindex = fileindex;
+            ncid = ncinputncid[fileindex];
+            return 0;
+        }
+    }
+    
+    /* A Zarr store has no NetCDF id, it is only read through the cached file slots */
+    
+    zarrversion = zarrstoreversion(netcdffilename);
+    if (zarrversion > 0) {
+        printf("Opening Zarr v%d Store: %s\n",zarrversion,netcdffilename);
+        if (ncinputfilecount >= MAXNCINPUTFILES) {
+            printf("Too many input files to open Zarr store %s\n",netcdffilename);
+            exit(1);
+        }
+        ncid = -1;
+    }
+    else {
+        printf("Opening NetCDF File: %s\n",netcdffilename); 
+        ncstat = nc_open(netcdffilename, NC_NOWRITE, &ncid);
+        check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    if (ncinputfilecount < MAXNCINPUTFILES) {
+        fileindex = ncinputfilecount;
+        sprintf(ncinputfilename[fileindex],"%s",canonicalname);
+        ncinputncid[fileindex] = ncid;
+        ncinputvarcount[fileindex] = 0;
+        ncinputzarr[fileindex] = zarrversion;
+        ncinputfilecount++;
+        ncinputfileindex = fileindex;
+        ncinputfilesize[fileindex] = -1;
+        if (diskcacheenabled == 1 && zarrversion == 0) {
+            hashinputfile(netcdffilename,fileindex);
+        }
+        if (zarrversion == 0) {
+            mapclassicfile(netcdffilename,fileindex);
+            openh5chunkfile(netcdffilename,fileindex);
+        }
+        else {
+            ncinputformat[fileindex] = 0;
+            ncinputmap[fileindex] = NULL;
+            ncinputh5file[fileindex] = -1;
+        }
+    }
+    else {
+        ncinputfileindex = -1;
+    }
+
+    return 0;
+
+}
+
+int
+closencinputfile() {
+
+    /* Input files are cached open, only an uncached file is closed here */
+
+    if (ncinputfileindex < 0) {
+        ncstat = nc_close(ncid);
+        check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    ncinputfileindex = -1;
+
+    return 0;
+
+}
+
+int
+closeallncinputfiles() {
+
+    int fileindex, varindex;
+    
+    for (fileindex = 0; fileindex < ncinputfilecount; fileindex++) {
+        if (ncinputzarr[fileindex] > 0) {
+            ncinputzarr[fileindex] = 0;
+            continue;
+        }
+        ncstat = nc_close(ncinputncid[fileindex]);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (ncinputmap[fileindex] != NULL) {
+            munmap(ncinputmap[fileindex],ncinputmapsize[fileindex]);
+            close(ncinputmapfile[fileindex]);
+            ncinputmap[fileindex] = NULL;
+            ncinputmapfile[fileindex] = -1;
+        }
+        if (ncinputh5file[fileindex] >= 0) {
+            for (varindex = 0; varindex < ncinputvarcount[fileindex]; varindex++) {
+                if (ncinputvarh5[fileindex][varindex] >= 0) {
+                    H5Dclose(ncinputvarh5[fileindex][varindex]);
+                }
+            }
+            H5Fclose(ncinputh5file[fileindex]);
+            ncinputh5file[fileindex] = -1;
+        }
+    }
+    
+    ncinputfilecount = 0;
+    ncinputfileindex = -1;
+
+    return 0;
+
+}
+
+int
+sizechunkcache(int fileindex, int varindex, int varid) {
+
+    /* Room for every chunk of one time step across the other dimensions, which for a variable */
+    /* chunked along time keeps the whole time chunk resident while successive years are read. */
+    /* The cache is only ever raised above the library default, up to MAXCHUNKCACHE, and once  */
+    /* the raised caches reach MAXCHUNKCACHETOTAL further variables keep the default.          */
+
+    size_t cachebytes, cacheslots, nchunks, defaultbytes, defaultslots;
+    float defaultpreemption;
+    int dimindex, ndims;
+    
+    ndims = ncinputvarndims[fileindex][varindex];
+    if (ndims > MAXNCVARDIMS) {
+        return 0;
+    }
+    
+    nchunks = 1;
+    for (dimindex = 0; dimindex < ndims; dimindex++) {
+        if (dimindex != ndims - 3) {
+            nchunks *= (ncinputvardimlen[fileindex][varindex][dimindex] + ncinputvarchunk[fileindex][varindex][dimindex] - 1) / ncinputvarchunk[fileindex][varindex][dimindex];
+        }
+    }
+    cachebytes = nchunks * sizeof(float);
+    for (dimindex = 0; dimindex < ndims; dimindex++) {
+        cachebytes *= ncinputvarchunk[fileindex][varindex][dimindex];
+    }
+    if (cachebytes > MAXCHUNKCACHE) {
+        cachebytes = MAXCHUNKCACHE;
+    }
+    cacheslots = 10 * nchunks + 1;
+    
+    ncstat = nc_get_chunk_cache(&defaultbytes,&defaultslots,&defaultpreemption);
+    check_err(ncstat,__LINE__,__FILE__);
+    if (cachebytes <= defaultbytes || chunkcachebytes + cachebytes > MAXCHUNKCACHETOTAL) {
+        return 0;
+    }
+    if (cacheslots < defaultslots) {
+        cacheslots = defaultslots;
+    }
+    chunkcachebytes += cachebytes;
+    
+    ncstat = nc_set_var_chunk_cache(ncid, varid, cachebytes, cacheslots, 0.75);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    return 0;
+
+}
+
+int
+countchunkcache(int varindex, int ndims, size_t *start) {
+
+    /* Counts whether a read falls in the same time chunk as the previous read of this variable */
+
+    long timechunk;
+    int fileindex;
+    
+    fileindex = ncinputfileindex;
+    if (fileindex < 0 || varindex < 0 || ndims < 3) {
+        return 0;
+    }
+    
+    timechunk = start[ndims - 3] / ncinputvarchunk[fileindex][varindex][ndims - 3];
+    if (timechunk == ncinputvarlastchunk[fileindex][varindex]) {
+        chunksametimereads++;
+    }
+    else {
+        chunknewtimereads++;
+    }
+    ncinputvarlastchunk[fileindex][varindex] = timechunk;
+
+    return 0;
+
+}
+
+int
+inqncvarid(char *FieldName, int *varid) {
+
+    int varindex, dimindex, storage;
+    int dimids[NC_MAX_VAR_DIMS];
+    size_t chunks[NC_MAX_VAR_DIMS];
+
+    if (ncinputfileindex < 0) {
+        ncstat =  nc_inq_varid(ncid, FieldName, varid);
+        check_err(ncstat,__LINE__,__FILE__);
+        return -1;
+    }
+    
+    for (varindex = 0; varindex < ncinputvarcount[ncinputfileindex]; varindex++) {
+        if (strcmp(ncinputvarname[ncinputfileindex][varindex],FieldName) == 0) {
+            *varid = ncinputvarid[ncinputfileindex][varindex];
+            return varindex;
+        }
+    }
+    
+    if (ncinputzarr[ncinputfileindex] > 0) {
+        if (ncinputvarcount[ncinputfileindex] >= MAXNCINPUTVARS) {
+            printf("Too many variables read from Zarr store %s\n",ncinputfilename[ncinputfileindex]);
+            exit(1);
+        }
+        varindex = ncinputvarcount[ncinputfileindex];
+        sprintf(ncinputvarname[ncinputfileindex][varindex],"%s",FieldName);
+        *varid = varindex;
+        ncinputvarid[ncinputfileindex][varindex] = varindex;
+        openzarrvar(ncinputfileindex,varindex,FieldName);
+        ncinputvarbegin[ncinputfileindex][varindex] = -1;
+        ncinputvarrecord[ncinputfileindex][varindex] = 0;
+        ncinputvarh5[ncinputfileindex][varindex] = -1;
+        ncinputvarlastchunk[ncinputfileindex][varindex] = -1;
+        ncinputvarcount[ncinputfileindex]++;
+        return varindex;
+    }
+    
+    ncstat =  nc_inq_varid(ncid, FieldName, varid);
+    check_err(ncstat,__LINE__,__FILE__);
+    
+    if (ncinputvarcount[ncinputfileindex] >= MAXNCINPUTVARS) {
+        return -1;
+    }
+    
+    /* First use of this variable in this file, record its shape and chunking */
+    
+    varindex = ncinputvarcount[ncinputfileindex];
+    sprintf(ncinputvarname[ncinputfileindex][varindex],"%s",FieldName);
+    ncinputvarid[ncinputfileindex][varindex] = *varid;
+    
+    ncstat = nc_inq_varndims(ncid, *varid, &ncinputvarndims[ncinputfileindex][varindex]);
+    check_err(ncstat,__LINE__,__FILE__);
+    ncstat = nc_inq_vardimid(ncid, *varid, dimids);
+    check_err(ncstat,__LINE__,__FILE__);
+    ncstat = nc_inq_var_chunking(ncid, *varid, &storage, chunks);
+    check_err(ncstat,__LINE__,__FILE__);
+    
+    for (dimindex = 0; dimindex < MAXNCVARDIMS; dimindex++) {
+        ncinputvardimlen[ncinputfileindex][varindex][dimindex] = 1;
+        ncinputvarchunk[ncinputfileindex][varindex][dimindex] = 1;
+        if (dimindex < ncinputvarndims[ncinputfileindex][varindex]) {
+            ncstat = nc_inq_dimlen(ncid, dimids[dimindex], &ncinputvardimlen[ncinputfileindex][varindex][dimindex]);
+            check_err(ncstat,__LINE__,__FILE__);
+            if (storage == NC_CHUNKED) {
+                ncinputvarchunk[ncinputfileindex][varindex][dimindex] = chunks[dimindex];
+            }
+            else {
+                ncinputvarchunk[ncinputfileindex][varindex][dimindex] = ncinputvardimlen[ncinputfileindex][varindex][dimindex];
+            }
+        }
+    }
+    
+    ncinputvarbegin[ncinputfileindex][varindex] = -1;
+    ncinputvarrecord[ncinputfileindex][varindex] = 0;
+    if (ncinputmap[ncinputfileindex] != NULL && ncinputvarndims[ncinputfileindex][varindex] <= MAXNCVARDIMS) {
+        scanclassicheader(ncinputfileindex,FieldName,&ncinputvarbegin[ncinputfileindex][varindex],&ncinputvarrecord[ncinputfileindex][varindex]);
+    }
+    openh5chunkvar(ncinputfileindex,varindex,FieldName);
+    
+    ncinputvarlastchunk[ncinputfileindex][varindex] = -1;
+    if (storage == NC_CHUNKED) {
+        sizechunkcache(ncinputfileindex,varindex,*varid);
+    }
+    
+    ncinputvarcount[ncinputfileindex]++;
+
+    return varindex;
+
+}
+
+int
+createncoutputfile(char *netcdffilename) {
+
+    /* Creates and defines the output file and leaves it open in data mode for writegrids */
+
+    size_t outputbuffer = OUTPUTBUFFERBYTES;
+    int oldfill;
+
+    printf("Creating NetCDF File: %s\n",netcdffilename); 
+
+    /* enter define mode with a large buffer, each year is written once front to back */
+    ncstat = nc__create(netcdffilename, NC_CLOBBER|NC_CDF5, 0, &outputbuffer, &ncid);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    /* every variable is written in full, skip prefilling them with fill values */
+    ncstat = nc_set_fill(ncid, NC_NOFILL, &oldfill);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    /* define dimensions */
+    ncstat = nc_def_dim(ncid, "natpft", natpft_len, &natpft_dim);
+    check_err(ncstat,__LINE__,__FILE__);
+    ncstat = nc_def_dim(ncid, "cft", cft_len, &cft_dim);
+    check_err(ncstat,__LINE__,__FILE__);
+    ncstat = nc_def_dim(ncid, "lon", lon_len, &lon_dim);
+    check_err(ncstat,__LINE__,__FILE__);
+    ncstat = nc_def_dim(ncid, "lat", lat_len, &lat_dim);
+    check_err(ncstat,__LINE__,__FILE__);
+    ncstat = nc_def_dim(ncid, "nchar", nchar_len, &nchar_dim);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    /* define variables */
+
+    natpft_dims[0] = natpft_dim;
+    ncstat = nc_def_var(ncid, "natpft", NC_INT, RANK_natpft, natpft_dims, &natpft_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    cft_dims[0] = cft_dim;
+    ncstat = nc_def_var(ncid, "cft", NC_INT, RANK_cft, cft_dims, &cft_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    ncstat = nc_def_var(ncid, "EDGEN", NC_FLOAT, RANK_EDGEN, 0, &EDGEN_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    ncstat = nc_def_var(ncid, "EDGEE", NC_FLOAT, RANK_EDGEE, 0, &EDGEE_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    ncstat = nc_def_var(ncid, "EDGES", NC_FLOAT, RANK_EDGES, 0, &EDGES_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    ncstat = nc_def_var(ncid, "EDGEW", NC_FLOAT, RANK_EDGEW, 0, &EDGEW_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    LAT_dims[0] = lat_dim;
+    ncstat = nc_def_var(ncid, "LAT", NC_FLOAT, RANK_LAT, LAT_dims, &LAT_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    LATIXY_dims[0] = lat_dim;
+    LATIXY_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "LATIXY", NC_FLOAT, RANK_LATIXY, LATIXY_dims, &LATIXY_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    LON_dims[0] = lon_dim;
+    ncstat = nc_def_var(ncid, "LON", NC_FLOAT, RANK_LON, LON_dims, &LON_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    LONGXY_dims[0] = lat_dim;
+    LONGXY_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "LONGXY", NC_FLOAT, RANK_LONGXY, LONGXY_dims, &LONGXY_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    LANDMASK_dims[0] = lat_dim;
+    LANDMASK_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "LANDMASK", NC_FLOAT, RANK_LANDMASK, LANDMASK_dims, &LANDMASK_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    LANDFRAC_dims[0] = lat_dim;
+    LANDFRAC_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "LANDFRAC", NC_DOUBLE, RANK_LANDFRAC, LANDFRAC_dims, &LANDFRAC_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    AREA_dims[0] = lat_dim;
+    AREA_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "AREA", NC_DOUBLE, RANK_AREA, AREA_dims, &AREA_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_GLACIER_dims[0] = lat_dim;
+    PCT_GLACIER_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_GLACIER", NC_DOUBLE, RANK_PCT_GLACIER, PCT_GLACIER_dims, &PCT_GLACIER_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_LAKE_dims[0] = lat_dim;
+    PCT_LAKE_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_LAKE", NC_DOUBLE, RANK_PCT_LAKE, PCT_LAKE_dims, &PCT_LAKE_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_WETLAND_dims[0] = lat_dim;
+    PCT_WETLAND_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_WETLAND", NC_DOUBLE, RANK_PCT_WETLAND, PCT_WETLAND_dims, &PCT_WETLAND_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_URBAN_dims[0] = lat_dim;
+    PCT_URBAN_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_URBAN", NC_DOUBLE, RANK_PCT_URBAN, PCT_URBAN_dims, &PCT_URBAN_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_NATVEG_dims[0] = lat_dim;
+    PCT_NATVEG_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_NATVEG", NC_DOUBLE, RANK_PCT_NATVEG, PCT_NATVEG_dims, &PCT_NATVEG_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_CROP_dims[0] = lat_dim;
+    PCT_CROP_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_CROP", NC_DOUBLE, RANK_PCT_CROP, PCT_CROP_dims, &PCT_CROP_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_NAT_PFT_dims[0] = natpft_dim;
+    PCT_NAT_PFT_dims[1] = lat_dim;
+    PCT_NAT_PFT_dims[2] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_NAT_PFT", NC_DOUBLE, RANK_PCT_NAT_PFT, PCT_NAT_PFT_dims, &PCT_NAT_PFT_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    PCT_CFT_dims[0] = cft_dim;
+    PCT_CFT_dims[1] = lat_dim;
+    PCT_CFT_dims[2] = lon_dim;
+    ncstat = nc_def_var(ncid, "PCT_CFT", NC_DOUBLE, RANK_PCT_CFT, PCT_CFT_dims, &PCT_CFT_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    FERTNITRO_CFT_dims[0] = cft_dim;
+    FERTNITRO_CFT_dims[1] = lat_dim;
+    FERTNITRO_CFT_dims[2] = lon_dim;
+    ncstat = nc_def_var(ncid, "FERTNITRO_CFT", NC_DOUBLE, RANK_FERTNITRO_CFT, FERTNITRO_CFT_dims, &FERTNITRO_CFT_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    HARVEST_VH1_dims[0] = lat_dim;
+    HARVEST_VH1_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "HARVEST_VH1", NC_DOUBLE, RANK_HARVEST_VH1, HARVEST_VH1_dims, &HARVEST_VH1_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    HARVEST_VH2_dims[0] = lat_dim;
+    HARVEST_VH2_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "HARVEST_VH2", NC_DOUBLE, RANK_HARVEST_VH2, HARVEST_VH2_dims, &HARVEST_VH2_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    HARVEST_SH1_dims[0] = lat_dim;
+    HARVEST_SH1_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "HARVEST_SH1", NC_DOUBLE, RANK_HARVEST_SH1, HARVEST_SH1_dims, &HARVEST_SH1_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    HARVEST_SH2_dims[0] = lat_dim;
+    HARVEST_SH2_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "HARVEST_SH2", NC_DOUBLE, RANK_HARVEST_SH2, HARVEST_SH2_dims, &HARVEST_SH2_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    HARVEST_SH3_dims[0] = lat_dim;
+    HARVEST_SH3_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "HARVEST_SH3", NC_DOUBLE, RANK_HARVEST_SH3, HARVEST_SH3_dims, &HARVEST_SH3_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    GRAZING_dims[0] = lat_dim;
+    GRAZING_dims[1] = lon_dim;
+    ncstat = nc_def_var(ncid, "GRAZING", NC_DOUBLE, RANK_GRAZING, GRAZING_dims, &GRAZING_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    UNREPRESENTED_PFT_LULCC_dims[0] = natpft_dim;
+    UNREPRESENTED_PFT_LULCC_dims[1] = lat_dim;
+    UNREPRESENTED_PFT_LULCC_dims[2] = lon_dim;
+    ncstat = nc_def_var(ncid, "UNREPRESENTED_PFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_PFT_LULCC, UNREPRESENTED_PFT_LULCC_dims, &UNREPRESENTED_PFT_LULCC_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    UNREPRESENTED_CFT_LULCC_dims[0] = cft_dim;
+    UNREPRESENTED_CFT_LULCC_dims[1] = lat_dim;
+    UNREPRESENTED_CFT_LULCC_dims[2] = lon_dim;
+    ncstat = nc_def_var(ncid, "UNREPRESENTED_CFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_CFT_LULCC, UNREPRESENTED_CFT_LULCC_dims, &UNREPRESENTED_CFT_LULCC_id);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    /* assign global attributes */
+
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "Conventions", 8, "NCAR-CSM");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "Author", strlen(authorname), authorname);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "History_Log", strlen(timestamp), timestamp);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "Region", strlen(regionfilename), regionfilename);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMCurrentDB", strlen(ctsmcurrentsurfdb), ctsmcurrentsurfdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMForestDB", strlen(ctsmLUHforestdb), ctsmLUHforestdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMPastureDB", strlen(ctsmLUHpasturedb), ctsmLUHpasturedb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMOtherDB", strlen(ctsmLUHotherdb), ctsmLUHotherdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC3AnnDB", strlen(ctsmLUHc3anndb), ctsmLUHc3anndb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC4AnnDB", strlen(ctsmLUHc4anndb), ctsmLUHc4anndb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC3PerDB", strlen(ctsmLUHc3perdb), ctsmLUHc3perdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC4PerDB", strlen(ctsmLUHc4perdb), ctsmLUHc4perdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC3NfxDB", strlen(ctsmLUHc3nfxdb), ctsmLUHc3nfxdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "LUH2StatesDB",strlen(luhstatesdb),luhstatesdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "LUH2ManagementDB",strlen(luhmanagementdb),luhmanagementdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+    {
+    ncstat = nc_put_att_text(ncid, NC_GLOBAL, "LUH2TransitionsDB",strlen(luhtransitionsdb),luhtransitionsdb);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+    
+
+    /* assign per-variable attributes */
+
+    {
+    ncstat = nc_put_att_text(ncid, natpft_id, "long_name", 23, "indices of natural PFTs");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, natpft_id, "units", 5, "index");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, cft_id, "long_name", 15, "indices of CFTs");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, cft_id, "units", 5, "index");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGEN_id, "long_name", 29, "northern edge of surface grid");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGEN_id, "units", 13, "degrees north");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGEE_id, "long_name", 28, "eastern edge of surface grid");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGEE_id, "units", 12, "degrees east");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGES_id, "long_name", 29, "southern edge of surface grid");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGES_id, "units", 13, "degrees north");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGEW_id, "long_name", 28, "western edge of surface grid");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, EDGEW_id, "units", 12, "degrees east");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LAT_id, "long_name", 3, "lat");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LAT_id, "units", 13, "degrees north");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const float mksrf_file__FillValue_att[1] = {((float)9.96921e+36)} ;
+    ncstat = nc_put_att_float(ncid, LATIXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LATIXY_id, "long_name", 11, "latitude-2d");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LATIXY_id, "units", 13, "degrees north");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LON_id, "long_name", 3, "lon");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LON_id, "units", 12, "degrees east");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const float mksrf_file__FillValue_att[1] = {((float)9.96921e+36)} ;
+    ncstat = nc_put_att_float(ncid, LONGXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LONGXY_id, "long_name", 12, "longitude-2d");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LONGXY_id, "units", 12, "degrees east");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LANDMASK_id, "long_name", 9, "land mask");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LANDMASK_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LANDFRAC_id, "long_name", 25, "land fraction of gridcell");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, LANDFRAC_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, AREA_id, "long_name", 16, "area of gridcell");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, AREA_id, "units", 4, "km^2");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_GLACIER_id, "long_name", 30, "total percent glacier landunit");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_GLACIER_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_GLACIER_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_LAKE_id, "long_name", 27, "total percent lake landunit");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_LAKE_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_LAKE_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_WETLAND_id, "long_name", 30, "total percent wetland landunit");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_WETLAND_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_WETLAND_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_URBAN_id, "long_name", 28, "total percent urban landunit");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_URBAN_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_URBAN_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_NATVEG_id, "long_name", 41, "total percent natural vegetation landunit");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_NATVEG_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_NATVEG_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_CROP_id, "long_name", 27, "total percent crop landunit");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_CROP_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_CROP_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_NAT_PFT_id, "long_name", 73, "percent plant functional type on the natural veg landunit (% of landunit)");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_NAT_PFT_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_NAT_PFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_CFT_id, "long_name", 65, "percent crop functional type on the crop landunit (% of landunit)");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, PCT_CFT_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, PCT_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, FERTNITRO_CFT_id, "long_name", 33, "nitrogen fertilizer for each crop");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, FERTNITRO_CFT_id, "units", 8, "gN/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, FERTNITRO_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_VH1_id, "long_name", 27, "harvest from primary forest");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_VH1_id, "units", 8, "gC/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, HARVEST_VH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_VH2_id, "long_name", 31, "harvest from primary non-forest");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_VH2_id, "units", 8, "gC/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, HARVEST_VH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_SH1_id, "long_name", 36, "harvest from secondary mature-forest");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_SH1_id, "units", 8, "gC/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, HARVEST_SH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_SH2_id, "long_name", 35, "harvest from secondary young-forest");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_SH2_id, "units", 8, "gC/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, HARVEST_SH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_SH3_id, "long_name", 33, "harvest from secondary non-forest");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, HARVEST_SH3_id, "units", 8, "gC/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, HARVEST_SH3_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, GRAZING_id, "long_name", 25, "grazing of herbacous pfts");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, GRAZING_id, "units", 8, "gC/m2/yr");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, GRAZING_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, UNREPRESENTED_PFT_LULCC_id, "long_name", 41, "unrepresented PFT gross LULCC transitions");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, UNREPRESENTED_PFT_LULCC_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, UNREPRESENTED_PFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    ncstat = nc_put_att_text(ncid, UNREPRESENTED_CFT_LULCC_id, "long_name", 42, "unrepresented crop gross LULCC transitions");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
     {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMOtherDB", strlen(ctsmLUHotherdb), ctsmLUHotherdb);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat = nc_put_att_text(ncid, UNREPRESENTED_CFT_LULCC_id, "units", 8, "unitless");
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+    {
+    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
+    ncstat = nc_put_att_double(ncid, UNREPRESENTED_CFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    check_err(ncstat,__LINE__,__FILE__);
+    }
+
+
+    /* leave define mode with spare header space and page aligned variables */
+    ncstat = nc__enddef (ncid, OUTPUTHEADERPAD, OUTPUTALIGN, 0, OUTPUTALIGN);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    return 0;
+}
+
+int
+closencfile() {
+
+    ncstat = nc_close(ncid);
+    check_err(ncstat,__LINE__,__FILE__);
+
+    return 0;
+
+}
+
+long inputlatoffset(int flipgrid) {
+
+    /* Inputs are global 0.25 degree grids, flipped inputs run north to south */
+
+    if (flipgrid == 1) {
+        return OUTLATOFFSET;
+    }
+    
+    return OUTLATSOUTHOFFSET;
+
+}
+
+unsigned long hashslicekey(int fileindex, char *FieldName, int index1d, int index2d, int flipgrid) {
+
+    /* FNV-1a over the file, variable name, indices and flip */
+
+    unsigned long hashvalue = 14695981039346656037UL;
+    int keyvalues[4], keyid;
+    char *keychar;
+    
+    keyvalues[0] = fileindex;
+    keyvalues[1] = index1d;
+    keyvalues[2] = index2d;
+    keyvalues[3] = flipgrid;
+    
+    for (keychar = FieldName; *keychar != '\0'; keychar++) {
+        hashvalue = (hashvalue ^ (unsigned char) *keychar) * 1099511628211UL;
+    }
+    for (keyid = 0; keyid < 4; keyid++) {
+        hashvalue = (hashvalue ^ (unsigned int) keyvalues[keyid]) * 1099511628211UL;
+    }
+    
+    return hashvalue;
+
+}
+
+void *asyncreadthread(void *arg) {
+
+    /* Reads queued slots until the program ends */
+
+    int slot;
+    long result;
+    
+    pthread_mutex_lock(&asyncreadlock);
+    while (1) {
+        for (slot = 0; slot < ASYNCREADSLOTS && asyncreadstate[slot] != 1; slot++) {
+        }
+        if (slot == ASYNCREADSLOTS) {
+            pthread_cond_wait(&asyncreadqueued,&asyncreadlock);
+            continue;
+        }
+        asyncreadstate[slot] = 2;
+        pthread_mutex_unlock(&asyncreadlock);
+        result = preadv(asyncreadfd[slot],asyncreadiov[slot],2,0);
+        pthread_mutex_lock(&asyncreadlock);
+        asyncreadresult[slot] = result;
+        asyncreadstate[slot] = 3;
+        pthread_cond_broadcast(&asyncreaddone);
+    }
+    
+    return NULL;
+
+}
+
+int freeasyncslot() {
+
+    int slot;
+    
+    pthread_mutex_lock(&asyncreadlock);
+    for (slot = 0; slot < ASYNCREADSLOTS && asyncreadstate[slot] != 0; slot++) {
+    }
+    pthread_mutex_unlock(&asyncreadlock);
+    
+    if (slot == ASYNCREADSLOTS) {
+        return -1;
+    }
+    
+    return slot;
+
+}
+
+int submitasyncread(int cachefile, float *targetgrid, size_t databytes) {
+
+    /* Queues a read of a disk cache slice header and data, returns the slot or -1 when all are busy */
+
+    int slot;
+    pthread_t threadid;
+#ifdef HAVE_LIBURING
+    struct io_uring_sqe *sqe;
+#endif
+    
+    slot = freeasyncslot();
+    if (slot < 0) {
+        return -1;
+    }
+    
+    asyncreadfd[slot] = cachefile;
+    asyncreadresult[slot] = -1;
+    asyncreadiov[slot][0].iov_base = asyncreadheader[slot];
+    asyncreadiov[slot][0].iov_len = DISKCACHEHEADER;
+    asyncreadiov[slot][1].iov_base = targetgrid;
+    asyncreadiov[slot][1].iov_len = databytes;
+    
+#ifdef HAVE_LIBURING
+    if (asyncreadringready < 0) {
+        asyncreadringready = (io_uring_queue_init(ASYNCREADSLOTS,&asyncreadring,0) == 0);
+    }
+    if (asyncreadringready == 1) {
+        sqe = io_uring_get_sqe(&asyncreadring);
+        if (sqe == NULL) {
+            return -1;
+        }
+        io_uring_prep_readv(sqe,cachefile,asyncreadiov[slot],2,0);
+        io_uring_sqe_set_data(sqe,(void *) (long) slot);
+        asyncreadstate[slot] = 2;
+        io_uring_submit(&asyncreadring);
+        return slot;
+    }
+#endif
+    
+    pthread_mutex_lock(&asyncreadlock);
+    if (asyncreadthreads < chunkthreads && pthread_create(&threadid,NULL,asyncreadthread,NULL) == 0) {
+        pthread_detach(threadid);
+        asyncreadthreads++;
+    }
+    if (asyncreadthreads == 0) {
+        pthread_mutex_unlock(&asyncreadlock);
+        return -1;
+    }
+    asyncreadstate[slot] = 1;
+    pthread_cond_signal(&asyncreadqueued);
+    pthread_mutex_unlock(&asyncreadlock);
+    
+    return slot;
+
+}
+
+int waitasyncread(int slot, size_t databytes) {
+
+    /* Waits for a slot and frees it, returns 1 when the whole slice was read under the expected key */
+
+    int complete;
+#ifdef HAVE_LIBURING
+    struct io_uring_cqe *cqe;
+    long doneslot;
+    
+    while (asyncreadringready == 1 && asyncreadstate[slot] == 2) {
+        if (io_uring_wait_cqe(&asyncreadring,&cqe) != 0) {
+            printf("Cannot wait for slice read ahead\n");
+            exit(1);
+        }
+        doneslot = (long) io_uring_cqe_get_data(cqe);
+        asyncreadresult[doneslot] = cqe->res;
+        asyncreadstate[doneslot] = 3;
+        io_uring_cqe_seen(&asyncreadring,cqe);
+    }
+#endif
+    
+    pthread_mutex_lock(&asyncreadlock);
+    while (asyncreadstate[slot] != 3) {
+        pthread_cond_wait(&asyncreaddone,&asyncreadlock);
+    }
+    pthread_mutex_unlock(&asyncreadlock);
+    
+    complete = (asyncreadresult[slot] == DISKCACHEHEADER + databytes && strncmp(asyncreadheader[slot],asyncreadkey[slot],DISKCACHEHEADER) == 0);
+    close(asyncreadfd[slot]);
+    pthread_mutex_lock(&asyncreadlock);
+    asyncreadstate[slot] = 0;
+    pthread_mutex_unlock(&asyncreadlock);
+    
+    return complete;
+
+}
+
+int dropslicecache(int sliceid) {
+
+    int lastid;
+    
+    free(slicecacheGrid[sliceid]);
+    slicecachebytes -= slicecachesize[sliceid];
+    
+    lastid = slicecachecount - 1;
+    slicecachekey[sliceid] = slicecachekey[lastid];
+    slicecachefile[sliceid] = slicecachefile[lastid];
+    sprintf(slicecachevar[sliceid],"%s",slicecachevar[lastid]);
+    slicecacheindex1[sliceid] = slicecacheindex1[lastid];
+    slicecacheindex2[sliceid] = slicecacheindex2[lastid];
+    slicecacheflip[sliceid] = slicecacheflip[lastid];
+    slicecacheused[sliceid] = slicecacheused[lastid];
+    slicecachepinned[sliceid] = slicecachepinned[lastid];
+    slicecachepending[sliceid] = slicecachepending[lastid];
+    slicecachesize[sliceid] = slicecachesize[lastid];
+    slicecacheGrid[sliceid] = slicecacheGrid[lastid];
+    slicecachecount--;
+    
+    return 0;
+
+}
+
+int packslicecache(int sliceid) {
+
+    /* Replaces a full slice by its LZ4 compressed form when slicecachecompress is set and it pays */
+
+#ifdef HAVE_LZ4
+    int packedbytes;
+    char *packed;
+    
+    if (slicecachecompress == 0 || slicecachesize[sliceid] != OUTDATASIZE || slicecachepending[sliceid] >= 0) {
+        return 0;
+    }
+    
+    if (slicecachepackbuffer == NULL) {
+        slicecachepackbuffer = (char *) malloc(LZ4_compressBound(OUTDATASIZE));
+        if (slicecachepackbuffer == NULL) {
+            return 0;
+        }
+    }
+    
+    packedbytes = LZ4_compress_default((char *) slicecacheGrid[sliceid],slicecachepackbuffer,OUTDATASIZE,LZ4_compressBound(OUTDATASIZE));
+    if (packedbytes <= 0 || packedbytes > OUTDATASIZE - OUTDATASIZE / 8) {
+        return 0;
+    }
+    packed = (char *) malloc(packedbytes);
+    if (packed == NULL) {
+        return 0;
+    }
+    
+    memcpy(packed,slicecachepackbuffer,packedbytes);
+    free(slicecacheGrid[sliceid]);
+    slicecacheGrid[sliceid] = (float *) packed;
+    slicecachebytes -= OUTDATASIZE - packedbytes;
+    slicecachesize[sliceid] = packedbytes;
+    
+    return 1;
+#else
+    return 0;
+#endif
+
+}
+
+int unpackslicecache(int sliceid, float *targetgrid) {
+
+    if (slicecachesize[sliceid] == OUTDATASIZE) {
+        memcpy(targetgrid,slicecacheGrid[sliceid],OUTDATASIZE);
+        return 0;
+    }
+    
+#ifdef HAVE_LZ4
+    if (LZ4_decompress_safe((char *) slicecacheGrid[sliceid],(char *) targetgrid,slicecachesize[sliceid],OUTDATASIZE) != OUTDATASIZE) {
+        printf("Compressed slice of %s in the slice cache is corrupt\n",slicecachevar[sliceid]);
+        exit(1);
+    }
+#endif
+    
+    return 0;
+
+}
+
+int lookupslicecache(char *FieldName, int index1d, int index2d, int flipgrid) {
+
+    unsigned long hashvalue;
+    int sliceid;
+    
+    if (ncinputfileindex < 0) {
+        return -1;
+    }
+    
+    hashvalue = hashslicekey(ncinputfileindex,FieldName,index1d,index2d,flipgrid);
+    for (sliceid = 0; sliceid < slicecachecount; sliceid++) {
+        if (slicecachekey[sliceid] == hashvalue && slicecachefile[sliceid] == ncinputfileindex && slicecacheindex1[sliceid] == index1d && slicecacheindex2[sliceid] == index2d && slicecacheflip[sliceid] == flipgrid && strcmp(slicecachevar[sliceid],FieldName) == 0) {
+            return sliceid;
+        }
+    }
+    
+    return -1;
+
+}
+
+int completeslicecache(int sliceid) {
+
+    /* Finishes a slice still being read ahead, a short or mismatched read drops it and returns 0 */
+
+    if (slicecachepending[sliceid] < 0) {
+        return 1;
+    }
+    
+    if (waitasyncread(slicecachepending[sliceid],OUTDATASIZE) == 0) {
+        prefetchrejected++;
+        dropslicecache(sliceid);
+        return 0;
+    }
+    slicecachepending[sliceid] = -1;
+    packslicecache(sliceid);
+    
+    return 1;
+
+}
+
+int findslicecache(char *FieldName, int index1d, int index2d, int flipgrid) {
+
+    int sliceid;
+    
+    sliceid = lookupslicecache(FieldName,index1d,index2d,flipgrid);
+    if (sliceid >= 0 && completeslicecache(sliceid) == 0) {
+        return -1;
+    }
+    
+    return sliceid;
+
+}
+
+int noteslicestride(char *FieldName, int index1d, int index2d, int flipgrid, int wholeslice) {
+
+    /* A repeated index keeps its entry, the next index advances it, anything else starts a new one. */
+    /* wholeslice is 0 for readers taking only some rows, the year planner leaves those alone.       */
+
+    int strideid, nextid;
+    
+    if (ncinputfileindex < 0 || index1d < 0) {
+        return 0;
+    }
+    
+    nextid = -1;
+    for (strideid = 0; strideid < slicestridecount; strideid++) {
+        if (slicestridefile[strideid] == ncinputfileindex && slicestrideindex2[strideid] == index2d && slicestrideflip[strideid] == flipgrid && strcmp(slicestridevar[strideid],FieldName) == 0) {
+            if (slicestrideindex1[strideid] == index1d) {
+                slicestrideround[strideid] = prefetchround;
+                slicestridewhole[strideid] |= wholeslice;
+                return 0;
+            }
+            if (slicestrideindex1[strideid] + 1 == index1d && nextid < 0) {
+                nextid = strideid;
+            }
+        }
+    }
+    
+    if (nextid >= 0) {
+        slicestrideindex1[nextid] = index1d;
+        slicestridestep[nextid] = 1;
+        slicestrideround[nextid] = prefetchround;
+        slicestrideadvanced[nextid] = prefetchround;
+        slicestridewhole[nextid] |= wholeslice;
+        return 0;
+    }
+    
+    if (slicestridecount < MAXSLICESTRIDES) {
+        strideid = slicestridecount;
+        slicestridefile[strideid] = ncinputfileindex;
+        sprintf(slicestridevar[strideid],"%s",FieldName);
+        slicestrideindex1[strideid] = index1d;
+        slicestrideindex2[strideid] = index2d;
+        slicestrideflip[strideid] = flipgrid;
+        slicestridestep[strideid] = 0;
+        slicestrideround[strideid] = prefetchround;
+        slicestrideadvanced[strideid] = -1;
+        slicestridewhole[strideid] = wholeslice;
+        slicestridecount++;
+    }
+    
+    return 0;
+
+}
+
+int readslicecache(char *FieldName, int index1d, int index2d, float *targetgrid, int flipgrid) {
+
+    int sliceid;
+    
+    noteslicestride(FieldName,index1d,index2d,flipgrid,1);
+    
+    sliceid = findslicecache(FieldName,index1d,index2d,flipgrid);
+    if (sliceid < 0) {
+        if (ncinputfileindex >= 0) {
+            slicecachemisses++;
+        }
+        return 0;
+    }
+    
+    unpackslicecache(sliceid,targetgrid);
+    slicecacheclock++;
+    slicecacheused[sliceid] = slicecacheclock;
+    slicecachepinned[sliceid] = 0;
+    slicecachehits++;
+    slicecachebytessaved += OUTDATASIZE;
+    
+    return 1;
+
+}
+
+int evictslicecache() {
+
+    /* Drop the least recently used unpinned slice, returns 0 when nothing can be dropped */
+
+    int sliceid, oldestid;
+    
+    oldestid = -1;
+    for (sliceid = 0; sliceid < slicecachecount; sliceid++) {
+        if (slicecachepinned[sliceid] == 0 && slicecachepending[sliceid] < 0 && (oldestid < 0 || slicecacheused[sliceid] < slicecacheused[oldestid])) {
+            oldestid = sliceid;
+        }
+    }
+    
+    if (oldestid < 0) {
+        return 0;
+    }
+    
+    dropslicecache(oldestid);
+    slicecacheevictions++;
+    
+    return 1;
+
+}
+
+int newslicecache(char *FieldName, int index1d, int index2d, int flipgrid) {
+
+    /* Adds an empty slice for the current input file, returns its id or -1 when out of memory */
+
+    int sliceid;
+    
+    sliceid = slicecachecount;
+    slicecacheGrid[sliceid] = (float *) malloc(OUTDATASIZE);
+    if (slicecacheGrid[sliceid] == NULL) {
+        return -1;
+    }
+    
+    slicecachekey[sliceid] = hashslicekey(ncinputfileindex,FieldName,index1d,index2d,flipgrid);
+    slicecachefile[sliceid] = ncinputfileindex;
+    sprintf(slicecachevar[sliceid],"%s",FieldName);
+    slicecacheindex1[sliceid] = index1d;
+    slicecacheindex2[sliceid] = index2d;
+    slicecacheflip[sliceid] = flipgrid;
+    slicecacheclock++;
+    slicecacheused[sliceid] = slicecacheclock;
+    slicecachepinned[sliceid] = slicecachepinning;
+    slicecachepending[sliceid] = -1;
+    slicecachesize[sliceid] = OUTDATASIZE;
+    slicecachebytes += OUTDATASIZE;
+    slicecachecount++;
+    
+    return sliceid;
+
+}
+
+int storeslicecache(char *FieldName, int index1d, int index2d, float *targetgrid, int flipgrid) {
+
+    int sliceid;
+    
+    if (ncinputfileindex < 0 || OUTDATASIZE > slicecachebudget) {
+        return 0;
+    }
+    
+    while (slicecachecount >= MAXSLICECACHE || slicecachebytes + OUTDATASIZE > slicecachebudget) {
+        if (evictslicecache() == 0) {
+            return 0;
+        }
+    }
+    
+    sliceid = newslicecache(FieldName,index1d,index2d,flipgrid);
+    if (sliceid < 0) {
+        return 0;
+    }
+    
+    memcpy(slicecacheGrid[sliceid],targetgrid,OUTDATASIZE);
+    packslicecache(sliceid);
+    
+    return 1;
+
+}
+
+int diskcachekey(char *FieldName, int index1d, int index2d, int nlayers, int flipgrid, char *keytext, char *cachefilename) {
+
+    /* The key covers the source identity, variable, indices, flip and region window */
+
+    unsigned long hashvalue = 14695981039346656037UL;
+    char *keychar;
+    
+    if (diskcacheenabled == 0 || ncinputfileindex < 0 || ncinputfilesize[ncinputfileindex] < 0) {
+        return 0;
+    }
+    
+    memset(keytext,0,DISKCACHEHEADER);
+    sprintf(keytext,"%lld %lld %llu %llu %016lx %s %d %d %d %d %ld %ld %ld %ld",ncinputfilesize[ncinputfileindex],ncinputfilemtime[ncinputfileindex],ncinputfileinode[ncinputfileindex],ncinputfiledevice[ncinputfileindex],ncinputfilehash[ncinputfileindex],FieldName,index1d,index2d,nlayers,flipgrid,inputlatoffset(flipgrid),OUTLONOFFSET,MAXOUTLIN,MAXOUTPIX);
+    for (keychar = keytext; *keychar != '\0'; keychar++) {
+        hashvalue = (hashvalue ^ (unsigned char) *keychar) * 1099511628211UL;
+    }
+    sprintf(cachefilename,"%s/%016lx.slice",diskcachedir,hashvalue);
+    
+    return 1;
+
+}
+
+int readdiskcache(char *FieldName, int index1d, int index2d, int nlayers, float *targetgrid, int flipgrid) {
+
+    char keytext[DISKCACHEHEADER], cachefilename[1024], header[DISKCACHEHEADER];
+    size_t databytes;
+    long long filesize;
+    int cachefile;
+    void *mapped;
+    
+    if (diskcachekey(FieldName,index1d,index2d,nlayers,flipgrid,keytext,cachefilename) == 0) {
+        return 0;
+    }
+    
+    cachefile = open(cachefilename,O_RDONLY);
+    if (cachefile < 0) {
+        return 0;
+    }
+    
+    databytes = nlayers * OUTDATASIZE;
+    filesize = lseek(cachefile,0,SEEK_END);
+    if (filesize != DISKCACHEHEADER + databytes || pread(cachefile,header,DISKCACHEHEADER,0) != DISKCACHEHEADER || strncmp(header,keytext,DISKCACHEHEADER) != 0) {
+        close(cachefile);
+        return 0;
+    }
+    
+    /* Map the slice over the grid when it owns whole pages, otherwise copy it in */
+    
+    if (ismappablegrid(targetgrid,databytes) == 1) {
+        mapped = mmap(targetgrid, databytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, cachefile, DISKCACHEHEADER);
+        if (mapped == MAP_FAILED) {
+            printf("Cannot map %s\n",cachefilename);
+            exit(1);
+        }
+        diskcachemapped++;
+    }
+    else {
+        if (pread(cachefile,targetgrid,databytes,DISKCACHEHEADER) != databytes) {
+            close(cachefile);
+            return 0;
+        }
+    }
+    
+    close(cachefile);
+    diskcachehits++;
+    
+    return 1;
+
+}
+
+int writediskcache(char *FieldName, int index1d, int index2d, int nlayers, float *targetgrid, int flipgrid) {
+
+    char keytext[DISKCACHEHEADER], cachefilename[1024], tempfilename[1100];
+    size_t databytes;
+    int cachefile, written;
+    
+    if (diskcachekey(FieldName,index1d,index2d,nlayers,flipgrid,keytext,cachefilename) == 0) {
+        return 0;
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC3AnnDB", strlen(ctsmLUHc3anndb), ctsmLUHc3anndb);
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Written under a temporary name and renamed so readers never see a partial slice */
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC4AnnDB", strlen(ctsmLUHc4anndb), ctsmLUHc4anndb);
-    check_err(stat,__LINE__,__FILE__);
+    sprintf(tempfilename,"%s.%d.tmp",cachefilename,(int) getpid());
+    cachefile = open(tempfilename,O_WRONLY | O_CREAT | O_TRUNC,0644);
+    if (cachefile < 0) {
+        printf("Cannot write slice cache in %s, disk cache disabled\n",diskcachedir);
+        diskcacheenabled = 0;
+        return 0;
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC3PerDB", strlen(ctsmLUHc3perdb), ctsmLUHc3perdb);
-    check_err(stat,__LINE__,__FILE__);
+    databytes = nlayers * OUTDATASIZE;
+    written = (pwrite(cachefile,keytext,DISKCACHEHEADER,0) == DISKCACHEHEADER && pwrite(cachefile,targetgrid,databytes,DISKCACHEHEADER) == databytes);
+    close(cachefile);
+    
+    if (written == 0 || rename(tempfilename,cachefilename) != 0) {
+        unlink(tempfilename);
+        return 0;
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC4PerDB", strlen(ctsmLUHc4perdb), ctsmLUHc4perdb);
-    check_err(stat,__LINE__,__FILE__);
+    diskcachewrites++;
+    
+    return 1;
+
+}
+
+int completeprefetches() {
+
+    /* Waits for every slice still being read ahead so it can be used or evicted like any other */
+
+    int sliceid;
+    
+    for (sliceid = slicecachecount - 1; sliceid >= 0; sliceid--) {
+        completeslicecache(sliceid);
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "CTSMC3NfxDB", strlen(ctsmLUHc3nfxdb), ctsmLUHc3nfxdb);
-    check_err(stat,__LINE__,__FILE__);
+    return 0;
+
+}
+
+int prefetchslices() {
+
+    /* Starts reading the disk cache slices of the next year for every variable read a year */
+    /* apart this round, as far as they fit the slice cache without evicting anything        */
+
+    int strideid, sliceid, slot, cachefile, savedfileindex, nextindex;
+    char cachefilename[1024];
+    
+    completeprefetches();
+    
+    if (diskcacheenabled == 0 || OUTDATASIZE > slicecachebudget) {
+        prefetchround++;
+        return 0;
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "LUH2StatesDB",strlen(luhstatesdb),luhstatesdb);
-    check_err(stat,__LINE__,__FILE__);
+    savedfileindex = ncinputfileindex;
+    
+    for (strideid = 0; strideid < slicestridecount; strideid++) {
+        if (slicestridestep[strideid] != 1 || slicestrideround[strideid] != prefetchround) {
+            continue;
+        }
+        if (slicecachecount >= MAXSLICECACHE || slicecachebytes + OUTDATASIZE > slicecachebudget) {
+            break;
+        }
+        ncinputfileindex = slicestridefile[strideid];
+        nextindex = slicestrideindex1[strideid] + 1;
+        if (lookupslicecache(slicestridevar[strideid],nextindex,slicestrideindex2[strideid],slicestrideflip[strideid]) >= 0) {
+            continue;
+        }
+        slot = freeasyncslot();
+        if (slot < 0) {
+            break;
+        }
+        if (diskcachekey(slicestridevar[strideid],nextindex,slicestrideindex2[strideid],1,slicestrideflip[strideid],asyncreadkey[slot],cachefilename) == 0) {
+            continue;
+        }
+        cachefile = open(cachefilename,O_RDONLY);
+        if (cachefile < 0) {
+            continue;
+        }
+        sliceid = newslicecache(slicestridevar[strideid],nextindex,slicestrideindex2[strideid],slicestrideflip[strideid]);
+        if (sliceid < 0) {
+            close(cachefile);
+            break;
+        }
+        slicecachepinned[sliceid] = 0;
+        if (submitasyncread(cachefile,slicecacheGrid[sliceid],OUTDATASIZE) != slot) {
+            close(cachefile);
+            dropslicecache(sliceid);
+            break;
+        }
+        slicecachepending[sliceid] = slot;
+        prefetchreads++;
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "LUH2ManagementDB",strlen(luhmanagementdb),luhmanagementdb);
-    check_err(stat,__LINE__,__FILE__);
+    ncinputfileindex = savedfileindex;
+    prefetchround++;
+    
+    return 0;
+
+}
+
+int printslicecachestats() {
+
+    int sliceid, pinnedcount, packedcount;
+    
+    pinnedcount = 0;
+    packedcount = 0;
+    for (sliceid = 0; sliceid < slicecachecount; sliceid++) {
+        pinnedcount += slicecachepinned[sliceid];
+        packedcount += (slicecachesize[sliceid] != OUTDATASIZE);
     }
     
-    {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "LUH2TransitionsDB",strlen(luhtransitionsdb),luhtransitionsdb);
-    check_err(stat,__LINE__,__FILE__);
+    printf("Slice cache hits %ld misses %ld evictions %ld, %.1f MB served from memory\n",slicecachehits,slicecachemisses,slicecacheevictions,slicecachebytessaved / 1048576.0);
+    printf("Slice cache holds %d slices (%d pinned, %d compressed) in %.1f of %.1f MB\n",slicecachecount,pinnedcount,packedcount,slicecachebytes / 1048576.0,slicecachebudget / 1048576.0);
+    if (diskcacheenabled == 1) {
+        printf("Disk slice cache hits %ld (%ld mapped) writes %ld in %s\n",diskcachehits,diskcachemapped,diskcachewrites,diskcachedir);
+        printf("Disk slice cache read ahead %ld slices (%ld rejected)\n",prefetchreads,prefetchrejected);
+    }
+    if (classicmapreads > 0) {
+        printf("Classic NetCDF slabs copied from mapped files %ld\n",classicmapreads);
+        printf("Classic NetCDF read ahead advised %.1f MB, released %.1f MB\n",classicadvisedbytes / 1048576.0,classicreleasedbytes / 1048576.0);
+        printf("Classic NetCDF slices planned %ld in %ld sequential runs\n",planreadslices,planreadruns);
+    }
+    if (blockreads > 0) {
+        printf("Block reads of %d years %ld\n",blockreadyears,blockreads);
+    }
+    if (chunksametimereads + chunknewtimereads > 0) {
+        printf("NetCDF chunked reads in the same time chunk as the previous read %ld, in a new time chunk %ld\n",chunksametimereads,chunknewtimereads);
+    }
+    if (h5chunkreads > 0) {
+        printf("NetCDF-4 slabs %ld assembled from %ld raw chunks on up to %d threads\n",h5chunkreads,h5chunkcount,chunkthreads);
+    }
+    if (zarrslabreads > 0) {
+        printf("Zarr slabs %ld assembled from %ld chunks (%ld never written) on up to %d threads\n",zarrslabreads,zarrchunkcount,zarrchunkmissing,chunkthreads);
     }
     
+    return 0;
 
-    /* assign per-variable attributes */
+}
 
-    {
-    stat = nc_put_att_text(ncid, natpft_id, "long_name", 23, "indices of natural PFTs");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int copyclassicrow(char *sourcerow, float *targetrow, long npix) {
 
-    {
-    stat = nc_put_att_text(ncid, natpft_id, "units", 5, "index");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Classic files are big endian, swap on little endian hosts in a loop the compiler vectorizes */
 
-    {
-    stat = nc_put_att_text(ncid, cft_id, "long_name", 15, "indices of CFTs");
-    check_err(stat,__LINE__,__FILE__);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    memcpy(targetrow,sourcerow,npix * sizeof(float));
+#else
+    uint32_t *sourceword = (uint32_t *) sourcerow;
+    uint32_t swapword;
+    long ctsmpix;
+    
+    for (ctsmpix = 0; ctsmpix < npix; ctsmpix++) {
+        swapword = __builtin_bswap32(sourceword[ctsmpix]);
+        memcpy(&targetrow[ctsmpix],&swapword,sizeof(float));
     }
+#endif
 
-    {
-    stat = nc_put_att_text(ncid, cft_id, "units", 5, "index");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    return 0;
 
-    {
-    stat = nc_put_att_text(ncid, EDGEN_id, "long_name", 29, "northern edge of surface grid");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, EDGEN_id, "units", 13, "degrees north");
-    check_err(stat,__LINE__,__FILE__);
-    }
+long long classicbyteoffset(int fileindex, int varindex, size_t *elementindex) {
 
-    {
-    stat = nc_put_att_text(ncid, EDGEE_id, "long_name", 28, "eastern edge of surface grid");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Byte offset of an element of a mapped classic variable, record variables step by the record size */
 
-    {
-    stat = nc_put_att_text(ncid, EDGEE_id, "units", 12, "degrees east");
-    check_err(stat,__LINE__,__FILE__);
+    long long byteoffset, linearindex;
+    size_t *dimlen;
+    int dimindex;
+    
+    dimlen = ncinputvardimlen[fileindex][varindex];
+    
+    linearindex = 0;
+    for (dimindex = ncinputvarrecord[fileindex][varindex]; dimindex < ncinputvarndims[fileindex][varindex]; dimindex++) {
+        linearindex = linearindex * dimlen[dimindex] + elementindex[dimindex];
     }
-
-    {
-    stat = nc_put_att_text(ncid, EDGES_id, "long_name", 29, "southern edge of surface grid");
-    check_err(stat,__LINE__,__FILE__);
+    byteoffset = ncinputvarbegin[fileindex][varindex] + linearindex * sizeof(float);
+    if (ncinputvarrecord[fileindex][varindex] == 1) {
+        byteoffset += elementindex[0] * ncinputrecsize[fileindex];
     }
+    
+    return byteoffset;
 
-    {
-    stat = nc_put_att_text(ncid, EDGES_id, "units", 13, "degrees north");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, EDGEW_id, "long_name", 28, "western edge of surface grid");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int readclassicslab(int varindex, int ndims, size_t *start, size_t *count, float *targetgrid, int flipgrid) {
 
-    {
-    stat = nc_put_att_text(ncid, EDGEW_id, "units", 12, "degrees east");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Copy a float hyperslab of a mapped classic file into targetgrid, flipping rows when asked. */
+    /* Leading dimensions become successive layers. Returns 0 when the slab is not mapped.        */
 
-    {
-    stat = nc_put_att_text(ncid, LAT_id, "long_name", 3, "lat");
-    check_err(stat,__LINE__,__FILE__);
+    long long byteoffset, layerid, nlayers, layerindex;
+    size_t *dimlen;
+    long ctsmlin, nlin, npix, targetlin;
+    int fileindex, dimindex;
+    size_t elementindex[MAXNCVARDIMS];
+    
+    fileindex = ncinputfileindex;
+    if (fileindex < 0 || varindex < 0 || ncinputvarbegin[fileindex][varindex] < 0 || ncinputvarndims[fileindex][varindex] != ndims || ndims < 2) {
+        return 0;
     }
-
-    {
-    stat = nc_put_att_text(ncid, LAT_id, "units", 13, "degrees north");
-    check_err(stat,__LINE__,__FILE__);
+    dimlen = ncinputvardimlen[fileindex][varindex];
+    
+    nlayers = 1;
+    for (dimindex = 0; dimindex < ndims; dimindex++) {
+        if (start[dimindex] + count[dimindex] > dimlen[dimindex]) {
+            return 0;
+        }
+        if (dimindex < ndims - 2) {
+            nlayers *= count[dimindex];
+        }
     }
-
-    {
-    static const float mksrf_file__FillValue_att[1] = {((float)9.96921e+36)} ;
-    stat = nc_put_att_float(ncid, LATIXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    nlin = count[ndims - 2];
+    npix = count[ndims - 1];
+    
+    for (layerid = 0; layerid < nlayers; layerid++) {
+        layerindex = layerid;
+        for (dimindex = ndims - 3; dimindex >= 0; dimindex--) {
+            elementindex[dimindex] = start[dimindex] + layerindex % count[dimindex];
+            layerindex /= count[dimindex];
+        }
+        for (ctsmlin = 0; ctsmlin < nlin; ctsmlin++) {
+            elementindex[ndims - 2] = start[ndims - 2] + ctsmlin;
+            elementindex[ndims - 1] = start[ndims - 1];
+            byteoffset = classicbyteoffset(fileindex,varindex,elementindex);
+            if (byteoffset + npix * (long long) sizeof(float) > ncinputmapsize[fileindex]) {
+                return 0;
+            }
+            targetlin = ctsmlin;
+            if (flipgrid == 1) {
+                targetlin = nlin - ctsmlin - 1;
+            }
+            copyclassicrow(&ncinputmap[fileindex][byteoffset],&targetgrid[(layerid * nlin + targetlin) * npix],npix);
+        }
     }
+    
+    classicmapreads++;
 
-    {
-    stat = nc_put_att_text(ncid, LATIXY_id, "long_name", 11, "latitude-2d");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    return 1;
 
-    {
-    stat = nc_put_att_text(ncid, LATIXY_id, "units", 13, "degrees north");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, LON_id, "long_name", 3, "lon");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int classicslicerange(int fileindex, int varindex, int index1d, int index2d, int flipgrid, long long *firstbyte, long long *endbyte) {
 
-    {
-    stat = nc_put_att_text(ncid, LON_id, "units", 12, "degrees east");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Bytes spanned by the region window rows of one year (and layer) of a mapped classic variable */
 
-    {
-    static const float mksrf_file__FillValue_att[1] = {((float)9.96921e+36)} ;
-    stat = nc_put_att_float(ncid, LONGXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    size_t *dimlen;
+    size_t elementindex[MAXNCVARDIMS];
+    int ndims;
+    
+    ndims = ncinputvarndims[fileindex][varindex];
+    dimlen = ncinputvardimlen[fileindex][varindex];
+    if (ncinputvarbegin[fileindex][varindex] < 0 || ndims < 3 || ndims > 4 || index1d < 0 || index1d >= dimlen[0]) {
+        return 0;
     }
-
-    {
-    stat = nc_put_att_text(ncid, LONGXY_id, "long_name", 12, "longitude-2d");
-    check_err(stat,__LINE__,__FILE__);
+    if (inputlatoffset(flipgrid) + MAXOUTLIN > dimlen[ndims - 2] || OUTLONOFFSET + MAXOUTPIX > dimlen[ndims - 1]) {
+        return 0;
     }
-
-    {
-    stat = nc_put_att_text(ncid, LONGXY_id, "units", 12, "degrees east");
-    check_err(stat,__LINE__,__FILE__);
+    
+    elementindex[0] = index1d;
+    if (ndims == 4) {
+        if (index2d < 0 || index2d >= dimlen[1]) {
+            return 0;
+        }
+        elementindex[1] = index2d;
     }
+    elementindex[ndims - 2] = inputlatoffset(flipgrid);
+    elementindex[ndims - 1] = OUTLONOFFSET;
+    *firstbyte = classicbyteoffset(fileindex,varindex,elementindex);
+    elementindex[ndims - 2] = inputlatoffset(flipgrid) + MAXOUTLIN - 1;
+    elementindex[ndims - 1] = OUTLONOFFSET + MAXOUTPIX - 1;
+    *endbyte = classicbyteoffset(fileindex,varindex,elementindex) + sizeof(float);
+    
+    return (*endbyte <= ncinputmapsize[fileindex]);
 
-    {
-    stat = nc_put_att_text(ncid, LANDMASK_id, "long_name", 9, "land mask");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, LANDMASK_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int adviseclassicslices() {
 
-    {
-    stat = nc_put_att_text(ncid, LANDFRAC_id, "long_name", 25, "land fraction of gridcell");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* For every mapped classic variable read a year apart this round, ask the kernel to read the */
+    /* next year ahead and drop the year just left behind when no other reader of it still trails */
 
-    {
-    stat = nc_put_att_text(ncid, LANDFRAC_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
+    int strideid, otherid, fileindex, varindex, retired;
+    long long firstbyte, endbyte, pagebyte, pageend;
+    long pagesize;
+    
+    pagesize = sysconf(_SC_PAGESIZE);
+    
+    for (strideid = 0; strideid < slicestridecount; strideid++) {
+        fileindex = slicestridefile[strideid];
+        if (slicestridestep[strideid] != 1 || slicestrideround[strideid] != prefetchround || ncinputmap[fileindex] == NULL) {
+            continue;
+        }
+        for (varindex = 0; varindex < ncinputvarcount[fileindex] && strcmp(ncinputvarname[fileindex][varindex],slicestridevar[strideid]) != 0; varindex++) {
+        }
+        if (varindex == ncinputvarcount[fileindex]) {
+            continue;
+        }
+        
+        if (classicslicerange(fileindex,varindex,slicestrideindex1[strideid] + 1,slicestrideindex2[strideid],slicestrideflip[strideid],&firstbyte,&endbyte) == 1) {
+            pagebyte = firstbyte - firstbyte % pagesize;
+            madvise(&ncinputmap[fileindex][pagebyte],endbyte - pagebyte,MADV_WILLNEED);
+            classicadvisedbytes += endbyte - firstbyte;
+        }
+        
+        if (slicestrideadvanced[strideid] != prefetchround) {
+            continue;
+        }
+        retired = 1;
+        for (otherid = 0; otherid < slicestridecount; otherid++) {
+            if (otherid != strideid && slicestridefile[otherid] == fileindex && slicestrideindex2[otherid] == slicestrideindex2[strideid] && slicestrideflip[otherid] == slicestrideflip[strideid] && strcmp(slicestridevar[otherid],slicestridevar[strideid]) == 0) {
+                if (slicestrideindex1[otherid] == slicestrideindex1[strideid] - 1 || (slicestrideindex1[otherid] < slicestrideindex1[strideid] - 1 && slicestridestep[otherid] == 1)) {
+                    retired = 0;
+                }
+            }
+        }
+        
+        /* Only whole pages inside the year are released so neighbouring data stays cached */
+        
+        if (retired == 1 && classicslicerange(fileindex,varindex,slicestrideindex1[strideid] - 1,slicestrideindex2[strideid],slicestrideflip[strideid],&firstbyte,&endbyte) == 1) {
+            pagebyte = (firstbyte + pagesize - 1) / pagesize * pagesize;
+            pageend = endbyte / pagesize * pagesize;
+            if (pageend > pagebyte) {
+                madvise(&ncinputmap[fileindex][pagebyte],pageend - pagebyte,MADV_DONTNEED);
+                posix_fadvise(ncinputmapfile[fileindex],pagebyte,pageend - pagebyte,POSIX_FADV_DONTNEED);
+                classicreleasedbytes += pageend - pagebyte;
+            }
+        }
     }
+    
+    return 0;
 
-    {
-    stat = nc_put_att_text(ncid, AREA_id, "long_name", 16, "area of gridcell");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, AREA_id, "units", 4, "km^2");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int compareplanreads(const void *first, const void *second) {
 
-    {
-    stat = nc_put_att_text(ncid, PCT_GLACIER_id, "long_name", 30, "total percent glacier landunit");
-    check_err(stat,__LINE__,__FILE__);
+    int firstid, secondid;
+    
+    firstid = *(const int *) first;
+    secondid = *(const int *) second;
+    
+    if (slicestridefile[planreadstride[firstid]] != slicestridefile[planreadstride[secondid]]) {
+        return slicestridefile[planreadstride[firstid]] - slicestridefile[planreadstride[secondid]];
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_GLACIER_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
+    if (planreadfirst[firstid] != planreadfirst[secondid]) {
+        return planreadfirst[firstid] < planreadfirst[secondid] ? -1 : 1;
     }
+    
+    return firstid - secondid;
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_GLACIER_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, PCT_LAKE_id, "long_name", 27, "total percent lake landunit");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int planyearreads() {
 
-    {
-    stat = nc_put_att_text(ncid, PCT_LAKE_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Reads this year's expected whole slices of mapped classic inputs in on disk order */
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_LAKE_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    int strideid, planid, runid, runendid, fileindex, varindex, sliceid, savedfileindex, ndims;
+    long long pagebyte, runend;
+    long pagesize;
+    size_t start[4], count[4];
+    
+    if (prefetchround == 0) {
+        return 0;
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_WETLAND_id, "long_name", 30, "total percent wetland landunit");
-    check_err(stat,__LINE__,__FILE__);
+    
+    savedfileindex = ncinputfileindex;
+    pagesize = sysconf(_SC_PAGESIZE);
+    
+    /* Collect the slices last year's requests point at and that are not cached yet */
+    
+    planreadcount = 0;
+    for (strideid = 0; strideid < slicestridecount; strideid++) {
+        fileindex = slicestridefile[strideid];
+        if (slicestridewhole[strideid] == 0 || slicestrideround[strideid] != prefetchround - 1 || ncinputmap[fileindex] == NULL) {
+            continue;
+        }
+        for (varindex = 0; varindex < ncinputvarcount[fileindex] && strcmp(ncinputvarname[fileindex][varindex],slicestridevar[strideid]) != 0; varindex++) {
+        }
+        if (varindex == ncinputvarcount[fileindex]) {
+            continue;
+        }
+        planid = planreadcount;
+        planreadstride[planid] = strideid;
+        planreadvar[planid] = varindex;
+        planreadindex1[planid] = slicestrideindex1[strideid];
+        if (slicestrideadvanced[strideid] == prefetchround - 1) {
+            planreadindex1[planid]++;
+        }
+        ncinputfileindex = fileindex;
+        if (lookupslicecache(slicestridevar[strideid],planreadindex1[planid],slicestrideindex2[strideid],slicestrideflip[strideid]) >= 0) {
+            continue;
+        }
+        if (classicslicerange(fileindex,varindex,planreadindex1[planid],slicestrideindex2[strideid],slicestrideflip[strideid],&planreadfirst[planid],&planreadend[planid]) == 0) {
+            continue;
+        }
+        planreadorder[planid] = planid;
+        planreadcount++;
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_WETLAND_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
+    
+    qsort(planreadorder,planreadcount,sizeof(int),compareplanreads);
+    
+    /* Each run of neighbouring slices is read ahead as one range, then copied out in order */
+    
+    runid = 0;
+    while (runid < planreadcount) {
+        fileindex = slicestridefile[planreadstride[planreadorder[runid]]];
+        runend = planreadend[planreadorder[runid]];
+        for (runendid = runid + 1; runendid < planreadcount && slicestridefile[planreadstride[planreadorder[runendid]]] == fileindex && planreadfirst[planreadorder[runendid]] <= runend + PLANREADGAP; runendid++) {
+            if (planreadend[planreadorder[runendid]] > runend) {
+                runend = planreadend[planreadorder[runendid]];
+            }
+        }
+        pagebyte = planreadfirst[planreadorder[runid]] - planreadfirst[planreadorder[runid]] % pagesize;
+        madvise(&ncinputmap[fileindex][pagebyte],runend - pagebyte,MADV_WILLNEED);
+        planreadruns++;
+        
+        ncinputfileindex = fileindex;
+        for (; runid < runendid; runid++) {
+            if (slicecachecount >= MAXSLICECACHE || slicecachebytes + OUTDATASIZE > slicecachebudget) {
+                ncinputfileindex = savedfileindex;
+                return 0;
+            }
+            planid = planreadorder[runid];
+            strideid = planreadstride[planid];
+            varindex = planreadvar[planid];
+            ndims = ncinputvarndims[fileindex][varindex];
+            start[0] = planreadindex1[planid];
+            start[1] = slicestrideindex2[strideid];
+            start[ndims - 2] = inputlatoffset(slicestrideflip[strideid]);
+            start[ndims - 1] = OUTLONOFFSET;
+            count[0] = 1;
+            count[1] = 1;
+            count[ndims - 2] = MAXOUTLIN;
+            count[ndims - 1] = MAXOUTPIX;
+            sliceid = newslicecache(slicestridevar[strideid],start[0],slicestrideindex2[strideid],slicestrideflip[strideid]);
+            if (sliceid < 0) {
+                ncinputfileindex = savedfileindex;
+                return 0;
+            }
+            slicecachepinned[sliceid] = 0;
+            if (readclassicslab(varindex,ndims,start,count,slicecacheGrid[sliceid],slicestrideflip[strideid]) == 0) {
+                dropslicecache(sliceid);
+                continue;
+            }
+            writediskcache(slicestridevar[strideid],start[0],slicestrideindex2[strideid],1,slicecacheGrid[sliceid],slicestrideflip[strideid]);
+            packslicecache(sliceid);
+            planreadslices++;
+        }
     }
+    
+    ncinputfileindex = savedfileindex;
+    
+    return 0;
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_WETLAND_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, PCT_URBAN_id, "long_name", 28, "total percent urban landunit");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int placeslabchunk(float *chunkbuffer, hsize_t *chunkdims, hsize_t *origin) {
 
-    {
-    stat = nc_put_att_text(ncid, PCT_URBAN_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Copy the overlap of a decoded chunk at origin with the slab being assembled into place */
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_URBAN_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    long long chunkoffset, layerindex;
+    long lo[MAXNCVARDIMS], hi[MAXNCVARDIMS], elementindex[MAXNCVARDIMS];
+    long targetlin;
+    int dimindex, lastdim;
+    
+    lastdim = h5slabndims - 1;
+    
+    for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+        lo[dimindex] = origin[dimindex] > h5slabstart[dimindex] ? origin[dimindex] : h5slabstart[dimindex];
+        hi[dimindex] = origin[dimindex] + chunkdims[dimindex] < h5slabstart[dimindex] + h5slabcount[dimindex] ? origin[dimindex] + chunkdims[dimindex] : h5slabstart[dimindex] + h5slabcount[dimindex];
+        elementindex[dimindex] = lo[dimindex];
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_NATVEG_id, "long_name", 41, "total percent natural vegetation landunit");
-    check_err(stat,__LINE__,__FILE__);
+    
+    while (elementindex[0] < hi[0]) {
+        chunkoffset = 0;
+        layerindex = 0;
+        for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+            chunkoffset = chunkoffset * chunkdims[dimindex] + elementindex[dimindex] - origin[dimindex];
+            if (dimindex < h5slabndims - 2) {
+                layerindex = layerindex * h5slabcount[dimindex] + elementindex[dimindex] - h5slabstart[dimindex];
+            }
+        }
+        targetlin = elementindex[lastdim - 1] - h5slabstart[lastdim - 1];
+        if (h5slabflip == 1) {
+            targetlin = h5slabcount[lastdim - 1] - targetlin - 1;
+        }
+        memcpy(&h5slabGrid[(layerindex * h5slabcount[lastdim - 1] + targetlin) * h5slabcount[lastdim] + lo[lastdim] - h5slabstart[lastdim]],&chunkbuffer[chunkoffset],(hi[lastdim] - lo[lastdim]) * sizeof(float));
+        for (dimindex = lastdim - 1; dimindex >= 0; dimindex--) {
+            elementindex[dimindex]++;
+            if (elementindex[dimindex] < hi[dimindex] || dimindex == 0) {
+                break;
+            }
+            elementindex[dimindex] = lo[dimindex];
+        }
     }
+    
+    return 0;
 
-    {
-    stat = nc_put_att_text(ncid, PCT_NATVEG_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_NATVEG_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+int copyh5chunk(long chunkid, uint32_t *chunkbuffer, uint32_t *shufflebuffer) {
 
-    {
-    stat = nc_put_att_text(ncid, PCT_CROP_id, "long_name", 27, "total percent crop landunit");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Inflate, unshuffle and byte swap one chunk, then copy its overlap with the slab into place */
 
-    {
-    stat = nc_put_att_text(ncid, PCT_CROP_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
+    uLongf chunkbytes, inflatebytes;
+    hsize_t *chunkdims, *origin;
+    long long nchunkwords, wordid;
+    int dimindex, byteid;
+    unsigned char *shufflebytes;
+    
+    chunkdims = ncinputvarh5chunk[h5slabfile][h5slabvar];
+    origin = h5chunkorigin[chunkid];
+    
+    nchunkwords = 1;
+    for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+        nchunkwords *= chunkdims[dimindex];
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_CROP_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    chunkbytes = nchunkwords * sizeof(float);
+    
+    if (ncinputvardeflate[h5slabfile][h5slabvar] == 1 && (h5chunkmask[chunkid] & (1 << ncinputvarshuffle[h5slabfile][h5slabvar])) == 0) {
+        inflatebytes = chunkbytes;
+        if (uncompress((Bytef *) chunkbuffer,&inflatebytes,h5chunkraw[chunkid],h5chunkrawsize[chunkid]) != Z_OK || inflatebytes != chunkbytes) {
+            return 1;
+        }
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_NAT_PFT_id, "long_name", 73, "percent plant functional type on the natural veg landunit (% of landunit)");
-    check_err(stat,__LINE__,__FILE__);
+    else if (h5chunkrawsize[chunkid] == chunkbytes) {
+        memcpy(chunkbuffer,h5chunkraw[chunkid],chunkbytes);
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_NAT_PFT_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
+    else {
+        return 1;
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_NAT_PFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    
+    if (ncinputvarshuffle[h5slabfile][h5slabvar] == 1 && (h5chunkmask[chunkid] & 1) == 0) {
+        shufflebytes = (unsigned char *) shufflebuffer;
+        for (byteid = 0; byteid < sizeof(float); byteid++) {
+            for (wordid = 0; wordid < nchunkwords; wordid++) {
+                shufflebytes[wordid * sizeof(float) + byteid] = ((unsigned char *) chunkbuffer)[byteid * nchunkwords + wordid];
+            }
+        }
+        memcpy(chunkbuffer,shufflebuffer,chunkbytes);
     }
-
-    {
-    stat = nc_put_att_text(ncid, PCT_CFT_id, "long_name", 65, "percent crop functional type on the crop landunit (% of landunit)");
-    check_err(stat,__LINE__,__FILE__);
+    
+    if (ncinputvarswap[h5slabfile][h5slabvar] == 1) {
+        for (wordid = 0; wordid < nchunkwords; wordid++) {
+            chunkbuffer[wordid] = __builtin_bswap32(chunkbuffer[wordid]);
+        }
     }
+    
+    placeslabchunk((float *) chunkbuffer,chunkdims,origin);
+    
+    return 0;
 
-    {
-    stat = nc_put_att_text(ncid, PCT_CFT_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+void *h5chunkthread(void *threadarg) {
 
-    {
-    stat = nc_put_att_text(ncid, FERTNITRO_CFT_id, "long_name", 33, "nitrogen fertilizer for each crop");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Take chunks of the current slab until none are left */
 
-    {
-    stat = nc_put_att_text(ncid, FERTNITRO_CFT_id, "units", 8, "gN/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
+    uint32_t *chunkbuffer, *shufflebuffer;
+    long long nchunkwords;
+    long chunkid;
+    int dimindex;
+    
+    nchunkwords = 1;
+    for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+        nchunkwords *= ncinputvarh5chunk[h5slabfile][h5slabvar][dimindex];
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, FERTNITRO_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    chunkbuffer = (uint32_t *) malloc(nchunkwords * sizeof(float));
+    shufflebuffer = (uint32_t *) malloc(nchunkwords * sizeof(float));
+    
+    while (1) {
+        pthread_mutex_lock(&h5chunklock);
+        chunkid = h5chunknext++;
+        pthread_mutex_unlock(&h5chunklock);
+        if (chunkid >= h5chunktotal) {
+            break;
+        }
+        if (copyh5chunk(chunkid,chunkbuffer,shufflebuffer) != 0) {
+            h5chunkfailed = 1;
+        }
     }
+    
+    free(chunkbuffer);
+    free(shufflebuffer);
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_VH1_id, "long_name", 27, "harvest from primary forest");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    return NULL;
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_VH1_id, "units", 8, "gC/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
+}
+
+int readh5chunkslab(int varindex, int ndims, size_t *start, size_t *count, float *targetgrid, int flipgrid) {
+
+    /* Read the raw chunks covering a float hyperslab of a NetCDF-4 file through HDF5, then inflate */
+    /* and place them on chunkthreads threads. Returns 0 when the slab has to go through NetCDF.    */
+
+    pthread_t threadid[MAXCHUNKTHREADS];
+    hsize_t chunkindex[MAXNCVARDIMS], firstchunk[MAXNCVARDIMS], lastchunk[MAXNCVARDIMS];
+    hsize_t *chunkdims;
+    hid_t h5var;
+    long chunkid, nchunks;
+    int fileindex, dimindex, nthreads, threadindex, usable;
+    
+    fileindex = ncinputfileindex;
+    if (fileindex < 0 || varindex < 0 || ncinputh5file[fileindex] < 0 || ncinputvarh5[fileindex][varindex] < 0 || ncinputvarndims[fileindex][varindex] != ndims || ndims < 2) {
+        return 0;
+    }
+    h5var = ncinputvarh5[fileindex][varindex];
+    chunkdims = ncinputvarh5chunk[fileindex][varindex];
+    
+    nchunks = 1;
+    for (dimindex = 0; dimindex < ndims; dimindex++) {
+        firstchunk[dimindex] = start[dimindex] / chunkdims[dimindex];
+        lastchunk[dimindex] = (start[dimindex] + count[dimindex] - 1) / chunkdims[dimindex];
+        chunkindex[dimindex] = firstchunk[dimindex];
+        nchunks *= lastchunk[dimindex] - firstchunk[dimindex] + 1;
+    }
+    
+    h5chunkraw = (unsigned char **) calloc(nchunks,sizeof(unsigned char *));
+    h5chunkrawsize = (hsize_t *) malloc(nchunks * sizeof(hsize_t));
+    h5chunkmask = (uint32_t *) malloc(nchunks * sizeof(uint32_t));
+    h5chunkorigin = (hsize_t (*)[MAXNCVARDIMS]) malloc(nchunks * sizeof(hsize_t[MAXNCVARDIMS]));
+    
+    /* HDF5 calls stay on this thread, only the inflate and copy are shared out */
+    
+    usable = 1;
+    for (chunkid = 0; chunkid < nchunks && usable; chunkid++) {
+        for (dimindex = 0; dimindex < ndims; dimindex++) {
+            h5chunkorigin[chunkid][dimindex] = chunkindex[dimindex] * chunkdims[dimindex];
+        }
+        if (H5Dget_chunk_storage_size(h5var,h5chunkorigin[chunkid],&h5chunkrawsize[chunkid]) < 0 || h5chunkrawsize[chunkid] == 0) {
+            usable = 0;
+        }
+        else {
+            h5chunkraw[chunkid] = (unsigned char *) malloc(h5chunkrawsize[chunkid]);
+            if (H5Dread_chunk(h5var,H5P_DEFAULT,h5chunkorigin[chunkid],&h5chunkmask[chunkid],h5chunkraw[chunkid]) < 0) {
+                usable = 0;
+            }
+        }
+        for (dimindex = ndims - 1; dimindex >= 0; dimindex--) {
+            chunkindex[dimindex]++;
+            if (chunkindex[dimindex] <= lastchunk[dimindex]) {
+                break;
+            }
+            chunkindex[dimindex] = firstchunk[dimindex];
+        }
+    }
+    
+    if (usable) {
+        h5slabfile = fileindex;
+        h5slabvar = varindex;
+        h5slabndims = ndims;
+        h5slabflip = flipgrid;
+        h5slabstart = start;
+        h5slabcount = count;
+        h5slabGrid = targetgrid;
+        h5chunktotal = nchunks;
+        h5chunknext = 0;
+        h5chunkfailed = 0;
+        nthreads = chunkthreads < nchunks ? chunkthreads : nchunks;
+        for (threadindex = 1; threadindex < nthreads; threadindex++) {
+            if (pthread_create(&threadid[threadindex],NULL,h5chunkthread,NULL) != 0) {
+                nthreads = threadindex;
+            }
+        }
+        h5chunkthread(NULL);
+        for (threadindex = 1; threadindex < nthreads; threadindex++) {
+            pthread_join(threadid[threadindex],NULL);
+        }
+        usable = (h5chunkfailed == 0);
+    }
+    
+    for (chunkid = 0; chunkid < nchunks; chunkid++) {
+        free(h5chunkraw[chunkid]);
+    }
+    free(h5chunkraw);
+    free(h5chunkrawsize);
+    free(h5chunkmask);
+    free(h5chunkorigin);
+    
+    if (usable == 0) {
+        return 0;
     }
+    
+    h5chunkreads++;
+    h5chunkcount += nchunks;
+    
+    return 1;
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_VH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_VH2_id, "long_name", 31, "harvest from primary non-forest");
-    check_err(stat,__LINE__,__FILE__);
-    }
+int inflatezarrchunk(unsigned char *source, size_t sourcebytes, unsigned char *target, size_t targetbytes) {
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_VH2_id, "units", 8, "gC/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* zlib and gzip streams both, the header is detected by inflate itself */
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_VH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    z_stream stream;
+    int status;
+    
+    memset(&stream,0,sizeof(stream));
+    if (inflateInit2(&stream,15 + 32) != Z_OK) {
+        return 1;
     }
-
-    {
-    stat = nc_put_att_text(ncid, HARVEST_SH1_id, "long_name", 36, "harvest from secondary mature-forest");
-    check_err(stat,__LINE__,__FILE__);
+    stream.next_in = source;
+    stream.avail_in = sourcebytes;
+    stream.next_out = target;
+    stream.avail_out = targetbytes;
+    status = inflate(&stream,Z_FINISH);
+    inflateEnd(&stream);
+    
+    if (status != Z_STREAM_END || stream.total_out != targetbytes) {
+        return 1;
     }
+    
+    return 0;
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_SH1_id, "units", 8, "gC/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_SH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+int copyzarrchunk(long chunkid, unsigned char **rawbuffer, size_t *rawbytes, unsigned char *decodebuffer, float *chunkbuffer) {
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_SH2_id, "long_name", 35, "harvest from secondary young-forest");
-    check_err(stat,__LINE__,__FILE__);
-    }
+    /* Read one chunk file, decompress, byte swap and narrow it to float, then place its overlap */
+    /* with the slab. A chunk file that was never written holds the fill value throughout.      */
 
-    {
-    stat = nc_put_att_text(ncid, HARVEST_SH2_id, "units", 8, "gC/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
+    char chunkfilename[PATH_MAX+NC_MAX_NAME+MAXNCVARDIMS*24];
+    hsize_t *chunkdims, *origin;
+    long long nchunkwords, wordid;
+    size_t chunkbytes, filebytes;
+    uint64_t swapword;
+    double doublevalue;
+    int chunkfile, dimindex, elementbytes, codec;
+    
+    chunkdims = ncinputvarh5chunk[h5slabfile][h5slabvar];
+    origin = h5chunkorigin[chunkid];
+    elementbytes = ncinputvarzarrbytes[h5slabfile][h5slabvar];
+    codec = ncinputvarzarrcodec[h5slabfile][h5slabvar];
+    
+    nchunkwords = 1;
+    for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+        nchunkwords *= chunkdims[dimindex];
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_SH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    chunkbytes = nchunkwords * elementbytes;
+    
+    sprintf(chunkfilename,"%s/%s/%s",ncinputfilename[h5slabfile],ncinputvarname[h5slabfile][h5slabvar],ncinputvarzarrprefix[h5slabfile][h5slabvar] ? "c" : "");
+    for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+        if (dimindex > 0 || ncinputvarzarrprefix[h5slabfile][h5slabvar]) {
+            sprintf(&chunkfilename[strlen(chunkfilename)],"%c",ncinputvarzarrseparator[h5slabfile][h5slabvar]);
+        }
+        sprintf(&chunkfilename[strlen(chunkfilename)],"%llu",(unsigned long long) (origin[dimindex] / chunkdims[dimindex]));
     }
-
-    {
-    stat = nc_put_att_text(ncid, HARVEST_SH3_id, "long_name", 33, "harvest from secondary non-forest");
-    check_err(stat,__LINE__,__FILE__);
+    
+    chunkfile = open(chunkfilename,O_RDONLY);
+    if (chunkfile < 0) {
+        for (wordid = 0; wordid < nchunkwords; wordid++) {
+            chunkbuffer[wordid] = ncinputvarzarrfill[h5slabfile][h5slabvar];
+        }
+        pthread_mutex_lock(&h5chunklock);
+        zarrchunkmissing++;
+        pthread_mutex_unlock(&h5chunklock);
+        placeslabchunk(chunkbuffer,chunkdims,origin);
+        return 0;
     }
-
-    {
-    stat = nc_put_att_text(ncid, HARVEST_SH3_id, "units", 8, "gC/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
+    filebytes = lseek(chunkfile,0,SEEK_END);
+    if (filebytes > *rawbytes) {
+        free(*rawbuffer);
+        *rawbuffer = (unsigned char *) malloc(filebytes);
+        *rawbytes = filebytes;
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_SH3_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    if (pread(chunkfile,*rawbuffer,filebytes,0) != filebytes) {
+        close(chunkfile);
+        return 1;
     }
-
-    {
-    stat = nc_put_att_text(ncid, GRAZING_id, "long_name", 25, "grazing of herbacous pfts");
-    check_err(stat,__LINE__,__FILE__);
+    close(chunkfile);
+    
+    if (codec == ZARRZLIB) {
+        if (inflatezarrchunk(*rawbuffer,filebytes,decodebuffer,chunkbytes) != 0) {
+            return 1;
+        }
     }
-
-    {
-    stat = nc_put_att_text(ncid, GRAZING_id, "units", 8, "gC/m2/yr");
-    check_err(stat,__LINE__,__FILE__);
+#ifdef HAVE_ZSTD
+    else if (codec == ZARRZSTD) {
+        if (ZSTD_decompress(decodebuffer,chunkbytes,*rawbuffer,filebytes) != chunkbytes) {
+            return 1;
+        }
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, GRAZING_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+#endif
+#ifdef HAVE_BLOSC
+    else if (codec == ZARRBLOSC) {
+        if (blosc_decompress_ctx(*rawbuffer,decodebuffer,chunkbytes,1) != chunkbytes) {
+            return 1;
+        }
     }
-
-    {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_PFT_LULCC_id, "long_name", 41, "unrepresented PFT gross LULCC transitions");
-    check_err(stat,__LINE__,__FILE__);
+#endif
+    else if (codec == ZARRRAW && filebytes == chunkbytes) {
+        memcpy(decodebuffer,*rawbuffer,chunkbytes);
     }
-
-    {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_PFT_LULCC_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
+    else {
+        return 1;
     }
-
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, UNREPRESENTED_PFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
+    
+    if (elementbytes == 4) {
+        if (ncinputvarswap[h5slabfile][h5slabvar] == 1) {
+            for (wordid = 0; wordid < nchunkwords; wordid++) {
+                ((uint32_t *) decodebuffer)[wordid] = __builtin_bswap32(((uint32_t *) decodebuffer)[wordid]);
+            }
+        }
+        memcpy(chunkbuffer,decodebuffer,chunkbytes);
     }
-
-    {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_CFT_LULCC_id, "long_name", 42, "unrepresented crop gross LULCC transitions");
-    check_err(stat,__LINE__,__FILE__);
+    else {
+        for (wordid = 0; wordid < nchunkwords; wordid++) {
+            memcpy(&swapword,&decodebuffer[wordid * 8],8);
+            if (ncinputvarswap[h5slabfile][h5slabvar] == 1) {
+                swapword = __builtin_bswap64(swapword);
+            }
+            memcpy(&doublevalue,&swapword,8);
+            chunkbuffer[wordid] = doublevalue;
+        }
     }
+    
+    placeslabchunk(chunkbuffer,chunkdims,origin);
+    
+    return 0;
 
-    {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_CFT_LULCC_id, "units", 8, "unitless");
-    check_err(stat,__LINE__,__FILE__);
-    }
+}
 
-    {
-    static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, UNREPRESENTED_CFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
-    check_err(stat,__LINE__,__FILE__);
-    }
+void *zarrchunkthread(void *threadarg) {
 
+    /* Take chunk files of the current slab until none are left */
 
-    /* leave define mode */
-    stat = nc_enddef (ncid);
-    check_err(stat,__LINE__,__FILE__);
+    unsigned char *rawbuffer, *decodebuffer;
+    float *chunkbuffer;
+    size_t rawbytes;
+    long long nchunkwords;
+    long chunkid;
+    int dimindex;
+    
+    nchunkwords = 1;
+    for (dimindex = 0; dimindex < h5slabndims; dimindex++) {
+        nchunkwords *= ncinputvarh5chunk[h5slabfile][h5slabvar][dimindex];
+    }
+    rawbytes = 0;
+    rawbuffer = NULL;
+    decodebuffer = (unsigned char *) malloc(nchunkwords * ncinputvarzarrbytes[h5slabfile][h5slabvar]);
+    chunkbuffer = (float *) malloc(nchunkwords * sizeof(float));
+    
+    while (1) {
+        pthread_mutex_lock(&h5chunklock);
+        chunkid = h5chunknext++;
+        pthread_mutex_unlock(&h5chunklock);
+        if (chunkid >= h5chunktotal) {
+            break;
+        }
+        if (copyzarrchunk(chunkid,&rawbuffer,&rawbytes,decodebuffer,chunkbuffer) != 0) {
+            h5chunkfailed = 1;
+        }
+    }
+    
+    free(rawbuffer);
+    free(decodebuffer);
+    free(chunkbuffer);
 
-    /* assign variable data */
+    return NULL;
 
-    stat = nc_close(ncid);
-    check_err(stat,__LINE__,__FILE__);
-    return 0;
 }
 
-int
-closencfile() {
+int readzarrslab(int varindex, int ndims, size_t *start, size_t *count, float *targetgrid, int flipgrid) {
 
-    stat = nc_close(ncid);
-    check_err(stat,__LINE__,__FILE__);
+    /* Assemble a float hyperslab of a Zarr array from its chunk files on chunkthreads threads. */
+    /* Returns 0 when the open input is not a Zarr store, a chunk that cannot be decoded stops. */
 
-    return 0;
+    pthread_t threadid[MAXCHUNKTHREADS];
+    hsize_t chunkindex[MAXNCVARDIMS], firstchunk[MAXNCVARDIMS], lastchunk[MAXNCVARDIMS];
+    hsize_t *chunkdims;
+    long chunkid, nchunks;
+    int fileindex, dimindex, nthreads, threadindex;
+    
+    fileindex = ncinputfileindex;
+    if (fileindex < 0 || varindex < 0 || ncinputzarr[fileindex] == 0 || ncinputvarndims[fileindex][varindex] != ndims || ndims < 2) {
+        return 0;
+    }
+    chunkdims = ncinputvarh5chunk[fileindex][varindex];
+    
+    nchunks = 1;
+    for (dimindex = 0; dimindex < ndims; dimindex++) {
+        firstchunk[dimindex] = start[dimindex] / chunkdims[dimindex];
+        lastchunk[dimindex] = (start[dimindex] + count[dimindex] - 1) / chunkdims[dimindex];
+        chunkindex[dimindex] = firstchunk[dimindex];
+        nchunks *= lastchunk[dimindex] - firstchunk[dimindex] + 1;
+    }
+    
+    h5chunkorigin = (hsize_t (*)[MAXNCVARDIMS]) malloc(nchunks * sizeof(hsize_t[MAXNCVARDIMS]));
+    for (chunkid = 0; chunkid < nchunks; chunkid++) {
+        for (dimindex = 0; dimindex < ndims; dimindex++) {
+            h5chunkorigin[chunkid][dimindex] = chunkindex[dimindex] * chunkdims[dimindex];
+        }
+        for (dimindex = ndims - 1; dimindex >= 0; dimindex--) {
+            chunkindex[dimindex]++;
+            if (chunkindex[dimindex] <= lastchunk[dimindex]) {
+                break;
+            }
+            chunkindex[dimindex] = firstchunk[dimindex];
+        }
+    }
+    
+    h5slabfile = fileindex;
+    h5slabvar = varindex;
+    h5slabndims = ndims;
+    h5slabflip = flipgrid;
+    h5slabstart = start;
+    h5slabcount = count;
+    h5slabGrid = targetgrid;
+    h5chunktotal = nchunks;
+    h5chunknext = 0;
+    h5chunkfailed = 0;
+    nthreads = chunkthreads < nchunks ? chunkthreads : nchunks;
+    for (threadindex = 1; threadindex < nthreads; threadindex++) {
+        if (pthread_create(&threadid[threadindex],NULL,zarrchunkthread,NULL) != 0) {
+            nthreads = threadindex;
+        }
+    }
+    zarrchunkthread(NULL);
+    for (threadindex = 1; threadindex < nthreads; threadindex++) {
+        pthread_join(threadid[threadindex],NULL);
+    }
+    free(h5chunkorigin);
+    
+    if (h5chunkfailed == 1) {
+        printf("Cannot decode chunks of Zarr array %s in %s\n",ncinputvarname[fileindex][varindex],ncinputfilename[fileindex]);
+        exit(1);
+    }
+    
+    zarrslabreads++;
+    zarrchunkcount += nchunks;
+    
+    return 1;
 
 }
 
@@ -1565,25 +4408,27 @@ int readnc0dfield(char *FieldName, float *targetvalue) {
 
     int varid;
         
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    inqncvarid(FieldName, &varid);
 
-    stat =  nc_get_var_float(ncid, varid, targetvalue);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_get_var_float(ncid, varid, targetvalue);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
 
 }
 
-int readnc1dfield(char *FieldName, float *targetarray) {
+int readnc1dfield(char *FieldName, long offset1d, long count1d, float *targetarray) {
 
     int varid;
+    size_t start[1], count[1];
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    count[0] = count1d;
+    start[0] = offset1d;
+    
+    inqncvarid(FieldName, &varid);
 
-    stat =  nc_get_var_float(ncid, varid, targetarray);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_get_vara_float(ncid, varid, start, count, targetarray);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
 
@@ -1593,75 +4438,283 @@ int readnc1dintfield(char *FieldName, int *targetarray) {
 
     int varid;
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    inqncvarid(FieldName, &varid);
 
-    stat =  nc_get_var_int(ncid, varid, targetarray);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_get_var_int(ncid, varid, targetarray);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
 
 }
 
-int readnc2dfield(char *FieldName, float *targetgrid, int flipgrid) {
+int fliprows(float *rowsgrid, long nlin) {
+
+    /* Reverses the order of nlin rows in place, swapping the rows from both ends inward */
 
-    int varid;
     long ctsmlin, ctsmpix, fliplin;
+    float swapvalue;
+    
+    for (ctsmlin = 0; ctsmlin < nlin / 2; ctsmlin++) {
+        fliplin = nlin - ctsmlin - 1;
+        for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+            swapvalue = rowsgrid[ctsmlin * MAXOUTPIX + ctsmpix];
+            rowsgrid[ctsmlin * MAXOUTPIX + ctsmpix] = rowsgrid[fliplin * MAXOUTPIX + ctsmpix];
+            rowsgrid[fliplin * MAXOUTPIX + ctsmpix] = swapvalue;
+        }
+    }
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    return 0;
+
+}
+
+int readnc2dfield(char *FieldName, float *targetgrid, int flipgrid) {
 
-    if (flipgrid == 0) {
-        stat =  nc_get_var_float(ncid, varid, targetgrid);
-        check_err(stat,__LINE__,__FILE__);
+    int varid, varindex;
+    size_t start[2], count[2];
+    
+    count[0] = MAXOUTLIN;
+    count[1] = MAXOUTPIX;
+    start[0] = inputlatoffset(flipgrid);
+    start[1] = OUTLONOFFSET;
+    
+    if (readslicecache(FieldName,-1,-1,targetgrid,flipgrid) == 1) {
+        return 0;
     }
-    else {
-        stat =  nc_get_var_float(ncid, varid, tempflipGrid);
-        check_err(stat,__LINE__,__FILE__);
-        for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-            fliplin = MAXOUTLIN - ctsmlin - 1;
-            for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-                targetgrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempflipGrid[fliplin * MAXOUTPIX + ctsmpix];
-            }
-	}
+    if (readdiskcache(FieldName,-1,-1,1,targetgrid,flipgrid) == 1) {
+        storeslicecache(FieldName,-1,-1,targetgrid,flipgrid);
+        return 0;
     }
     
+    varindex = inqncvarid(FieldName, &varid);
+
+    if (readclassicslab(varindex, 2, start, count, targetgrid, flipgrid) == 0 && readh5chunkslab(varindex, 2, start, count, targetgrid, flipgrid) == 0 && readzarrslab(varindex, 2, start, count, targetgrid, flipgrid) == 0) {
+        ncstat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (flipgrid == 1) {
+            fliprows(targetgrid,MAXOUTLIN);
+        }
+    }
+    
+    storeslicecache(FieldName,-1,-1,targetgrid,flipgrid);
+    writediskcache(FieldName,-1,-1,1,targetgrid,flipgrid);
+    
     return 0;
 
 }
 
 
+int readnc3dblock(char *FieldName, int varid, int varindex, int index1d, float *targetgrid, int flipgrid) {
+
+    /* Read up to blockreadyears years from index1d in one slab, keep the later years in the */
+    /* slice cache and return 0 when there is no block to read                               */
+
+    float *yearGrid;
+    size_t start[3], count[3];
+    int blockyear;
+    
+    if (ncinputfileindex < 0 || varindex < 0 || ncinputvarndims[ncinputfileindex][varindex] != 3) {
+        return 0;
+    }
+    
+    count[0] = ncinputvardimlen[ncinputfileindex][varindex][0] - index1d;
+    if (count[0] > blockreadyears) {
+        count[0] = blockreadyears;
+    }
+    if (count[0] < 2) {
+        return 0;
+    }
+    count[1] = MAXOUTLIN;
+    count[2] = MAXOUTPIX;
+    start[0] = index1d;
+    start[1] = inputlatoffset(flipgrid);
+    start[2] = OUTLONOFFSET;
+    
+    if (readclassicslab(varindex, 3, start, count, blockreadGrid, flipgrid) == 0 && readh5chunkslab(varindex, 3, start, count, blockreadGrid, flipgrid) == 0 && readzarrslab(varindex, 3, start, count, blockreadGrid, flipgrid) == 0) {
+        countchunkcache(varindex, 3, start);
+        ncstat =  nc_get_vara_float(ncid, varid, start, count, blockreadGrid);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (flipgrid == 1) {
+            for (blockyear = 0; blockyear < count[0]; blockyear++) {
+                fliprows(&blockreadGrid[blockyear * MAXOUTLIN * MAXOUTPIX],MAXOUTLIN);
+            }
+        }
+    }
+    
+    memcpy(targetgrid,blockreadGrid,OUTDATASIZE);
+    
+    for (blockyear = 0; blockyear < count[0]; blockyear++) {
+        yearGrid = &blockreadGrid[blockyear * MAXOUTLIN * MAXOUTPIX];
+        if (findslicecache(FieldName,index1d + blockyear,-1,flipgrid) < 0) {
+            storeslicecache(FieldName,index1d + blockyear,-1,yearGrid,flipgrid);
+        }
+        writediskcache(FieldName,index1d + blockyear,-1,1,yearGrid,flipgrid);
+    }
+    
+    blockreads++;
+    
+    return 1;
+
+}
+
 int readnc3dfield(char *FieldName, int index1d, float *targetgrid, int flipgrid) {
 
-    int varid;
-    long ctsmlin, ctsmpix, fliplin;
+    int varid, varindex;
     size_t start[3], count[3];
     
     count[0] = 1;
     count[1] = MAXOUTLIN;
     count[2] = MAXOUTPIX;
     start[0] = index1d;
-    start[1] = 0;
-    start[2] = 0;
+    start[1] = inputlatoffset(flipgrid);
+    start[2] = OUTLONOFFSET;
+    
+    if (readslicecache(FieldName,index1d,-1,targetgrid,flipgrid) == 1) {
+        return 0;
+    }
+    if (readdiskcache(FieldName,index1d,-1,1,targetgrid,flipgrid) == 1) {
+        storeslicecache(FieldName,index1d,-1,targetgrid,flipgrid);
+        return 0;
+    }
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    varindex = inqncvarid(FieldName, &varid);
 
-    if (flipgrid == 0) {
-        stat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
-        check_err(stat,__LINE__,__FILE__);
+    if (blockreading == 1 && readnc3dblock(FieldName, varid, varindex, index1d, targetgrid, flipgrid) == 1) {
+        return 0;
     }
-    else {
-        stat =  nc_get_vara_float(ncid, varid, start, count, tempflipGrid);
-        check_err(stat,__LINE__,__FILE__);
-        for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-            fliplin = MAXOUTLIN - ctsmlin - 1;
+
+    if (readclassicslab(varindex, 3, start, count, targetgrid, flipgrid) == 0 && readh5chunkslab(varindex, 3, start, count, targetgrid, flipgrid) == 0 && readzarrslab(varindex, 3, start, count, targetgrid, flipgrid) == 0) {
+        countchunkcache(varindex, 3, start);
+        ncstat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (flipgrid == 1) {
+            fliprows(targetgrid,MAXOUTLIN);
+        }
+    }
+    
+    storeslicecache(FieldName,index1d,-1,targetgrid,flipgrid);
+    writediskcache(FieldName,index1d,-1,1,targetgrid,flipgrid);
+        
+    return 0;
+    
+}
+
+
+int readnc3drows(char *FieldName, int index1d, long firstlin, long nlin, float *rowsgrid, int flipgrid) {
+
+    /* Reads output rows firstlin to firstlin + nlin - 1 of one year, flipped like readnc3dfield */
+
+    int varid, varindex;
+    size_t start[3], count[3];
+    
+    count[0] = 1;
+    count[1] = nlin;
+    count[2] = MAXOUTPIX;
+    start[0] = index1d;
+    start[1] = inputlatoffset(flipgrid) + firstlin;
+    if (flipgrid == 1) {
+        start[1] = inputlatoffset(flipgrid) + MAXOUTLIN - firstlin - nlin;
+    }
+    start[2] = OUTLONOFFSET;
+    
+    varindex = inqncvarid(FieldName, &varid);
+
+    if (readclassicslab(varindex, 3, start, count, rowsgrid, flipgrid) == 0 && readh5chunkslab(varindex, 3, start, count, rowsgrid, flipgrid) == 0 && readzarrslab(varindex, 3, start, count, rowsgrid, flipgrid) == 0) {
+        countchunkcache(varindex, 3, start);
+        ncstat =  nc_get_vara_float(ncid, varid, start, count, rowsgrid);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (flipgrid == 1) {
+            fliprows(rowsgrid,nlin);
+        }
+    }
+    
+    return 0;
+    
+}
+
+
+int accumulatenc3dfield(char *FieldName, int index1d, float *accumgrid, int firstfield, long startlin, long endlin, int flipgrid) {
+
+    /* Adds the valid (<= 1.0) values of rows startlin to endlin - 1 of one year of FieldName into */
+    /* accumgrid a few rows at a time, the first field of a sum starts with zero where not valid   */
+
+    int varid, varindex, sliceid;
+    long ctsmlin, ctsmpix, firstlin, nlin, nrows, rowphase, chunklin;
+    float *rowsgrid, *slicegrid, rowvalue;
+    
+    varindex = inqncvarid(FieldName, &varid);
+    
+    /* Raw chunk reads go whole chunk rows at a time, with block edges on the file's chunk row */
+    /* edges (output rows where rowphase + row is a multiple of nrows), so no chunk is inflated */
+    /* twice                                                                                     */
+    
+    nrows = ROWCHUNKLIN;
+    if (varindex >= 0 && (ncinputvarh5[ncinputfileindex][varindex] >= 0 || ncinputzarr[ncinputfileindex] > 0) && ncinputvarh5chunk[ncinputfileindex][varindex][1] > 0) {
+        chunklin = ncinputvarh5chunk[ncinputfileindex][varindex][1];
+        nrows = (ROWCHUNKLIN + chunklin - 1) / chunklin * chunklin;
+    }
+    rowphase = inputlatoffset(flipgrid) % nrows;
+    if (flipgrid == 1) {
+        rowphase = (nrows - (inputlatoffset(flipgrid) + MAXOUTLIN) % nrows) % nrows;
+    }
+    if (nrows > MAXOUTLIN) {
+        nrows = MAXOUTLIN;
+        rowphase = 0;
+    }
+    if (nrows > rowchunklin) {
+        free(rowchunkGrid);
+        rowchunkGrid = (float *) malloc(nrows * MAXOUTPIX * sizeof(float));
+        rowchunklin = nrows;
+    }
+    
+    noteslicestride(FieldName,index1d,-1,flipgrid,0);
+    
+    sliceid = findslicecache(FieldName,index1d,-1,flipgrid);
+    if (sliceid >= 0) {
+        slicecacheclock++;
+        slicecacheused[sliceid] = slicecacheclock;
+        slicecachepinned[sliceid] = 0;
+        slicecachehits++;
+        slicecachebytessaved += OUTDATASIZE;
+        slicegrid = slicecacheGrid[sliceid];
+        if (slicecachesize[sliceid] != OUTDATASIZE) {
+            if (slicecacheunpackGrid == NULL) {
+                slicecacheunpackGrid = (float *) malloc(OUTDATASIZE);
+            }
+            unpackslicecache(sliceid,slicecacheunpackGrid);
+            slicegrid = slicecacheunpackGrid;
+        }
+    }
+    
+    for (firstlin = startlin; firstlin < endlin; firstlin += nlin) {
+        nlin = nrows - (firstlin + rowphase) % nrows;
+        if (firstlin + nlin > endlin) {
+            nlin = endlin - firstlin;
+        }
+        if (sliceid >= 0) {
+            rowsgrid = &slicegrid[firstlin * MAXOUTPIX];
+        }
+        else {
+            readnc3drows(FieldName,index1d,firstlin,nlin,rowchunkGrid,flipgrid);
+            rowsgrid = rowchunkGrid;
+        }
+        for (ctsmlin = 0; ctsmlin < nlin; ctsmlin++) {
             for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-                targetgrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempflipGrid[fliplin * MAXOUTPIX + ctsmpix];
+                rowvalue = rowsgrid[ctsmlin * MAXOUTPIX + ctsmpix];
+                if (rowvalue <= 1.0) {
+                    if (firstfield == 1) {
+                        accumgrid[(firstlin + ctsmlin) * MAXOUTPIX + ctsmpix] = rowvalue;
+                    }
+                    else {
+                        accumgrid[(firstlin + ctsmlin) * MAXOUTPIX + ctsmpix] += rowvalue;
+                    }
+                }
+                else if (firstfield == 1) {
+                    accumgrid[(firstlin + ctsmlin) * MAXOUTPIX + ctsmpix] = 0.0;
+                }
             }
-	}
+        }
     }
-        
+    
     return 0;
     
 }
@@ -1669,8 +4722,7 @@ int readnc3dfield(char *FieldName, int index1d, float *targetgrid, int flipgrid)
 
 int readnc4dfield(char *FieldName, int index1d, int index2d, float *targetgrid, int flipgrid) {
 
-    int varid;
-    long ctsmlin, ctsmpix, fliplin;
+    int varid, varindex;
     size_t start[4], count[4];
     
     count[0] = 1;
@@ -1679,90 +4731,113 @@ int readnc4dfield(char *FieldName, int index1d, int index2d, float *targetgrid,
     count[3] = MAXOUTPIX;
     start[0] = index1d;
     start[1] = index2d;
-    start[2] = 0;
-    start[3] = 0;
+    start[2] = inputlatoffset(flipgrid);
+    start[3] = OUTLONOFFSET;
        
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
-
-    if (flipgrid == 0) {
-        stat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
-        check_err(stat,__LINE__,__FILE__);
+    if (readslicecache(FieldName,index1d,index2d,targetgrid,flipgrid) == 1) {
+        return 0;
     }
-    else {
-        stat =  nc_get_vara_float(ncid, varid, start, count, tempflipGrid);
-        check_err(stat,__LINE__,__FILE__);
-        for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-            fliplin = MAXOUTLIN - ctsmlin - 1;
-            for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-                targetgrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempflipGrid[fliplin * MAXOUTPIX + ctsmpix];
-            }
-	}
+    if (readdiskcache(FieldName,index1d,index2d,1,targetgrid,flipgrid) == 1) {
+        storeslicecache(FieldName,index1d,index2d,targetgrid,flipgrid);
+        return 0;
     }
+    
+    varindex = inqncvarid(FieldName, &varid);
+
+    if (readclassicslab(varindex, 4, start, count, targetgrid, flipgrid) == 0 && readh5chunkslab(varindex, 4, start, count, targetgrid, flipgrid) == 0 && readzarrslab(varindex, 4, start, count, targetgrid, flipgrid) == 0) {
+        countchunkcache(varindex, 4, start);
+        ncstat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (flipgrid == 1) {
+            fliprows(targetgrid,MAXOUTLIN);
+        }
+    }
+    
+    storeslicecache(FieldName,index1d,index2d,targetgrid,flipgrid);
+    writediskcache(FieldName,index1d,index2d,1,targetgrid,flipgrid);
         
     return 0;
     
 }
 
-int writenc0dfield(char *FieldName, float *targetvalue) {
+int readnc4dstack(char *FieldName, int nlayers, int index2d, float *targetstack, int flipgrid) {
 
-    int varid;
-    
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    /* Reads layers 0 to nlayers-1 of one year in a single hyperslab into a contiguous stack */
 
-    stat =  nc_put_var_float(ncid, varid, targetvalue);
-    check_err(stat,__LINE__,__FILE__);
+    int varid, varindex, layer;
+    size_t start[4], count[4];
+    
+    count[0] = nlayers;
+    count[1] = 1;
+    count[2] = MAXOUTLIN;
+    count[3] = MAXOUTPIX;
+    start[0] = 0;
+    start[1] = index2d;
+    start[2] = inputlatoffset(flipgrid);
+    start[3] = OUTLONOFFSET;
+       
+    if (readdiskcache(FieldName,-1,index2d,nlayers,targetstack,flipgrid) == 1) {
+        return 0;
+    }
+    
+    varindex = inqncvarid(FieldName, &varid);
+
+    if (readclassicslab(varindex, 4, start, count, targetstack, flipgrid) == 0 && readh5chunkslab(varindex, 4, start, count, targetstack, flipgrid) == 0 && readzarrslab(varindex, 4, start, count, targetstack, flipgrid) == 0) {
+        countchunkcache(varindex, 4, start);
+        ncstat =  nc_get_vara_float(ncid, varid, start, count, targetstack);
+        check_err(ncstat,__LINE__,__FILE__);
+        if (flipgrid == 1) {
+            for (layer = 0; layer < nlayers; layer++) {
+                fliprows(&targetstack[layer * MAXOUTLIN * MAXOUTPIX],MAXOUTLIN);
+            }
+        }
+    }
     
+    writediskcache(FieldName,-1,index2d,nlayers,targetstack,flipgrid);
+        
     return 0;
-
+    
 }
 
-int writenc1dfield(char *FieldName, float *targetarray) {
 
-    int varid;
-    
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+int writenc0dfield(int varid, float *targetvalue) {
 
-    stat =  nc_put_var_float(ncid, varid, targetarray);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_put_var_float(ncid, varid, targetvalue);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
 
 }
 
-int writenc1dintfield(char *FieldName, int *targetarray) {
-
-    int varid;
-    
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+int writenc1dfield(int varid, float *targetarray) {
 
-    stat =  nc_put_var_int(ncid, varid, targetarray);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_put_var_float(ncid, varid, targetarray);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
 
 }
 
-int writenc2dfield(char *FieldName, float *targetgrid) {
+int writenc1dintfield(int varid, int *targetarray) {
 
-    int varid;
+    ncstat =  nc_put_var_int(ncid, varid, targetarray);
+    check_err(ncstat,__LINE__,__FILE__);
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    return 0;
+
+}
+
+int writenc2dfield(int varid, float *targetgrid) {
 
-    stat =  nc_put_var_float(ncid, varid, targetgrid);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_put_var_float(ncid, varid, targetgrid);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
 
 }
 
-int writenc3dfield(char *FieldName, int index1d, float *targetgrid) {
+int writenc3dfield(int varid, int index1d, float *targetgrid) {
 
-    int varid;
     size_t start[3], count[3];
     
     count[0] = 1;
@@ -1771,56 +4846,111 @@ int writenc3dfield(char *FieldName, int index1d, float *targetgrid) {
     start[0] = index1d;
     start[1] = 0;
     start[2] = 0;
-        
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
 
-    stat =  nc_put_vara_float(ncid, varid, start, count, targetgrid);
-    check_err(stat,__LINE__,__FILE__);
+    ncstat =  nc_put_vara_float(ncid, varid, start, count, targetgrid);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
     
 }
 
-int writenc2ddblfield(char *FieldName, double *targetgrid) {
+int writenc2ddblfield(int varid, double *targetgrid) {
 
-    int varid;
+    ncstat =  nc_put_var_double(ncid, varid, targetgrid);
+    check_err(ncstat,__LINE__,__FILE__);
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    return 0;
+
+}
 
-    stat =  nc_put_var_double(ncid, varid, targetgrid);
-    check_err(stat,__LINE__,__FILE__);
+int writenc3ddblstack(int varid, double *targetstack) {
+
+    /* Writes every layer of a 3D double variable from one contiguous [layer][lat][lon] stack */
+
+    ncstat =  nc_put_var_double(ncid, varid, targetstack);
+    check_err(ncstat,__LINE__,__FILE__);
     
     return 0;
+    
+}
+
+int settropicrows() {
+
+  long ctsmlin;
+
+  tropicfirstlin = MAXOUTLIN;
+  tropicendlin = 0;
+  
+  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+      if (inLAT[ctsmlin] >= -30.0 && inLAT[ctsmlin] <= 30.0) {
+          if (ctsmlin < tropicfirstlin) {
+              tropicfirstlin = ctsmlin;
+	  }
+          tropicendlin = ctsmlin + 1;
+      }
+  }
+  
+  if (tropicfirstlin > tropicendlin) {
+      tropicfirstlin = tropicendlin;
+  }
+  
+  return 0;
 
 }
 
-int writenc3ddblfield(char *FieldName, int index3d, double *targetgrid) {
+int buildlandtiles() {
 
-    int varid;
-    size_t start[3], count[3];
-    
-    count[0] = 1;
-    count[1] = MAXOUTLIN;
-    count[2] = MAXOUTPIX;
-    start[0] = index3d;
-    start[1] = 0;
-    start[2] = 0;
-        
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+  long ctsmlin, ctsmpix, tilelin, tilepix;
+
+  memset(landtileGrid,0,landtilelin * landtilepix * sizeof(char));
+  
+  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1.0) {
+              landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] = 1;
+          }
+      }
+  }
+
+  landtilecount = 0;
+  landfirstlin = MAXOUTLIN;
+  landendlin = 0;
+  for (tilelin = 0; tilelin < landtilelin; tilelin++) {
+      for (tilepix = 0; tilepix < landtilepix; tilepix++) {
+          if (landtileGrid[tilelin * landtilepix + tilepix] == 1) {
+              landtilecount++;
+              if (tilelin * LANDTILESIZE < landfirstlin) {
+                  landfirstlin = tilelin * LANDTILESIZE;
+              }
+              landendlin = (tilelin + 1) * LANDTILESIZE;
+          }
+      }
+  }
+  if (landendlin > MAXOUTLIN) {
+      landendlin = MAXOUTLIN;
+  }
+
+  /* Unrepresented LULCC only reaches the output on land, skip tropical rows without any */
+  
+  if (tropicfirstlin < landfirstlin) {
+      tropicfirstlin = landfirstlin;
+  }
+  if (tropicendlin > landendlin) {
+      tropicendlin = landendlin;
+  }
+  if (tropicfirstlin > tropicendlin) {
+      tropicfirstlin = tropicendlin;
+  }
+
+  printf("Land tiles %ld of %ld, land rows %ld to %ld\n",landtilecount,landtilelin * landtilepix,landfirstlin,landendlin);
+  
+  return 0;
 
-    stat =  nc_put_vara_double(ncid, varid, start, count, targetgrid);
-    check_err(stat,__LINE__,__FILE__);
-    
-    return 0;
-    
 }
 
 int readctsmcurrentGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmcurrentsurfreadyear) {
       return 0;
@@ -1849,6 +4979,13 @@ int readctsmcurrentGrids(int currentyear) {
       }
   }
 
+  /* The 0D and 1D coordinate reads below go through the NetCDF library only */
+  
+  if (zarrstoreversion(ctsmcurrentsurfdb) > 0) {
+      printf("The CTSM current surface dataset must be a NetCDF file, %s is a Zarr store\n",ctsmcurrentsurfdb);
+      exit(1);
+  }
+  
   openncinputfile(ctsmcurrentsurfdb);
   
   readnc1dintfield("natpft",innatpft);
@@ -1857,11 +4994,14 @@ int readctsmcurrentGrids(int currentyear) {
   readnc0dfield("EDGEE",&inEDGEE);
   readnc0dfield("EDGES",&inEDGES);
   readnc0dfield("EDGEW",&inEDGEW);
-  readnc1dfield("LAT",inLAT);
+  readnc1dfield("LAT",OUTLATSOUTHOFFSET,MAXOUTLIN,inLAT);
+  settropicrows();
   readnc2dfield("LATIXY",inLATIXY,0);
-  readnc1dfield("LON",inLON);
+  readnc1dfield("LON",OUTLONOFFSET,MAXOUTPIX,inLON);
   readnc2dfield("LONGXY",inLONGXY,0);
   readnc2dfield("LANDMASK",inLANDMASKGrid,0);
+  buildlandtiles();
+  extrapcachevalid = 0;
   readnc2dfield("LANDFRAC",inLANDFRACGrid,0);
   readnc2dfield("AREA",inAREAGrid,0);
   readnc2dfield("PCT_GLACIER",inPCTGLACIERGrid,0);
@@ -1871,15 +5011,11 @@ int readctsmcurrentGrids(int currentyear) {
   readnc3dfield("PCT_NATVEG",yearindex,inPCTNATVEGGrid,0);
   readnc3dfield("PCT_CROP",yearindex,inPCTCROPGrid,0);
   
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc4dfield("PCT_NAT_PFT",pftid,yearindex,inCURRENTPCTPFTGrid[pftid],0);
-  }
+  readnc4dstack("PCT_NAT_PFT",MAXPFT,yearindex,inCURRENTPCTPFTStack,0);
   
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      readnc4dfield("PCT_CFT",cftid,yearindex,inCURRENTPCTCFTGrid[cftid],0);
-  }
+  readnc4dstack("PCT_CFT",MAXCFT,yearindex,inCURRENTPCTCFTStack,0);
   
-  closencfile();
+  closencinputfile();
 
   return 0;
   
@@ -1888,7 +5024,7 @@ int readctsmcurrentGrids(int currentyear) {
 
 int readctsmLUHforestGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHforestreadyear) {
       return 0;
@@ -1919,11 +5055,9 @@ int readctsmLUHforestGrids(int currentyear) {
   
   openncinputfile(ctsmLUHforestdb);  
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc4dfield("PCT_NAT_PFT",pftid,yearindex,inFORESTPCTPFTGrid[pftid],0);
-  }
+  readnc4dstack("PCT_NAT_PFT",MAXPFT,yearindex,inFORESTPCTPFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -1932,7 +5066,7 @@ int readctsmLUHforestGrids(int currentyear) {
   
 int readctsmLUHpastureGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHpasturereadyear) {
       return 0;
@@ -1963,11 +5097,9 @@ int readctsmLUHpastureGrids(int currentyear) {
   
   openncinputfile(ctsmLUHpasturedb);  
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc4dfield("PCT_NAT_PFT",pftid,yearindex,inPASTUREPCTPFTGrid[pftid],0);
-  }
+  readnc4dstack("PCT_NAT_PFT",MAXPFT,yearindex,inPASTUREPCTPFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -1976,7 +5108,7 @@ int readctsmLUHpastureGrids(int currentyear) {
 
 int readctsmLUHotherGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHotherreadyear) {
       return 0;
@@ -2007,11 +5139,9 @@ int readctsmLUHotherGrids(int currentyear) {
   
   openncinputfile(ctsmLUHotherdb);  
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc4dfield("PCT_NAT_PFT",pftid,yearindex,inOTHERPCTPFTGrid[pftid],0);
-  }
+  readnc4dstack("PCT_NAT_PFT",MAXPFT,yearindex,inOTHERPCTPFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2019,7 +5149,7 @@ int readctsmLUHotherGrids(int currentyear) {
 
 int readctsmLUHc3annGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHc3annreadyear) {
       return 0;
@@ -2050,11 +5180,9 @@ int readctsmLUHc3annGrids(int currentyear) {
   
   openncinputfile(ctsmLUHc3anndb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc4dfield("PCT_CFT",cftid,yearindex,inC3ANNPCTCFTGrid[cftid],0);
-  }
+  readnc4dstack("PCT_CFT",MAXCFTRAW,yearindex,inC3ANNPCTCFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2062,7 +5190,7 @@ int readctsmLUHc3annGrids(int currentyear) {
 
 int readctsmLUHc4annGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHc4annreadyear) {
       return 0;
@@ -2093,11 +5221,9 @@ int readctsmLUHc4annGrids(int currentyear) {
   
   openncinputfile(ctsmLUHc4anndb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc4dfield("PCT_CFT",cftid,yearindex,inC4ANNPCTCFTGrid[cftid],0);
-  }
+  readnc4dstack("PCT_CFT",MAXCFTRAW,yearindex,inC4ANNPCTCFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2105,7 +5231,7 @@ int readctsmLUHc4annGrids(int currentyear) {
 
 int readctsmLUHc3perGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHc3perreadyear) {
       return 0;
@@ -2136,11 +5262,9 @@ int readctsmLUHc3perGrids(int currentyear) {
   
   openncinputfile(ctsmLUHc3perdb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc4dfield("PCT_CFT",cftid,yearindex,inC3PERPCTCFTGrid[cftid],0);
-  }
+  readnc4dstack("PCT_CFT",MAXCFTRAW,yearindex,inC3PERPCTCFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2148,7 +5272,7 @@ int readctsmLUHc3perGrids(int currentyear) {
 
 int readctsmLUHc4perGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHc4perreadyear) {
       return 0;
@@ -2179,11 +5303,9 @@ int readctsmLUHc4perGrids(int currentyear) {
   
   openncinputfile(ctsmLUHc4perdb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc4dfield("PCT_CFT",cftid,yearindex,inC4PERPCTCFTGrid[cftid],0);
-  }
+  readnc4dstack("PCT_CFT",MAXCFTRAW,yearindex,inC4PERPCTCFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2191,7 +5313,7 @@ int readctsmLUHc4perGrids(int currentyear) {
 
 int readctsmLUHc3nfxGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex;
   
   if (currentyear == ctsmLUHc3nfxreadyear) {
       return 0;
@@ -2222,11 +5344,9 @@ int readctsmLUHc3nfxGrids(int currentyear) {
   
   openncinputfile(ctsmLUHc3nfxdb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc4dfield("PCT_CFT",cftid,yearindex,inC3NFXPCTCFTGrid[cftid],0);
-  }
+  readnc4dstack("PCT_CFT",MAXCFTRAW,yearindex,inC3NFXPCTCFTStack,0);
   
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2235,7 +5355,7 @@ int readctsmLUHc3nfxGrids(int currentyear) {
 
 int readLUHbasestateGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int yearindex, statesyearindex;
   
   if (currentyear == refstatesreadyear) {
       return 0;
@@ -2264,6 +5384,20 @@ int readLUHbasestateGrids(int currentyear) {
       }
   }
   
+  /* The base states are read again as current states in the reference year, */
+  /* keep them pinned until then when that year is part of the run           */
+  
+  statesyearindex = refyear - luhstatesstartyear;
+  if (refyear <= luhstatesstartyear) {
+      statesyearindex = 0;
+  }
+  if (refyear >= luhstatesendyear) {
+      statesyearindex = luhstatesendyear - luhstatesstartyear;
+  }
+  if (strcmp(refstatesdb,luhstatesdb) == 0 && statesyearindex == yearindex && refyear >= startyear && refyear <= endyear) {
+      slicecachepinning = 1;
+  }
+  
   openncinputfile(refstatesdb); 
 
   readnc3dfield("primf",yearindex,inBASEPRIMFGrid,flipLUHgrids);
@@ -2279,16 +5413,32 @@ int readLUHbasestateGrids(int currentyear) {
   readnc3dfield("c3nfx",yearindex,inBASEC3NFXGrid,flipLUHgrids);
   readnc3dfield("urban",yearindex,inBASEURBANGrid,flipLUHgrids);
   
-  closencfile();
+  slicecachepinning = 0;
+  closencinputfile();
 
   return 0;
   
 }
 
 
+float *findstatewindowGrid(int stateid, int yearindex) {
+
+  int slot;
+  
+  for (slot = 0; slot < 2; slot++) {
+      if (statewindowyearindex[slot] == yearindex) {
+          return inSTATEWINDOWGrid[slot][stateid];
+      }
+  }
+  
+  return NULL;
+  
+}
+
+
 int readLUHcurrstateGrids(int currentyear) {
 
-  int pftid, cftid, yearindex;
+  int pftid, cftid, yearindex, stateid;
   
   if (currentyear == luhcurrentstatesreadyear) {
       return 0;
@@ -2318,21 +5468,31 @@ int readLUHcurrstateGrids(int currentyear) {
   }
   
   openncinputfile(luhstatesdb); 
+  blockreading = 1;
 
   readnc3dfield("primf",yearindex,inCURRPRIMFGrid,flipLUHgrids);
   readnc3dfield("primn",yearindex,inCURRPRIMNGrid,flipLUHgrids);
-  readnc3dfield("secdf",yearindex,inCURRSECDFGrid,flipLUHgrids);
-  readnc3dfield("secdn",yearindex,inCURRSECDNGrid,flipLUHgrids);
-  readnc3dfield("pastr",yearindex,inCURRPASTRGrid,flipLUHgrids);
-  readnc3dfield("range",yearindex,inCURRRANGEGrid,flipLUHgrids);
-  readnc3dfield("c3ann",yearindex,inCURRC3ANNGrid,flipLUHgrids);
-  readnc3dfield("c4ann",yearindex,inCURRC4ANNGrid,flipLUHgrids);
-  readnc3dfield("c3per",yearindex,inCURRC3PERGrid,flipLUHgrids);
-  readnc3dfield("c4per",yearindex,inCURRC4PERGrid,flipLUHgrids);
-  readnc3dfield("c3nfx",yearindex,inCURRC3NFXGrid,flipLUHgrids);
   readnc3dfield("urban",yearindex,inCURRURBANGrid,flipLUHgrids);
+
+  /* The window slot not holding the current year becomes the current year, the */
+  /* previous current year stays in the other slot for the PREVDELTA grids       */
   
-  closencfile();
+  if (statewindowyearindex[statewindowcurrent] != yearindex) {
+      statewindowcurrent = 1 - statewindowcurrent;
+      if (statewindowyearindex[statewindowcurrent] != yearindex) {
+          for (stateid = 0; stateid < MAXSTATEWINDOW; stateid++) {
+              readnc3dfield(statewindowname[stateid],yearindex,inSTATEWINDOWGrid[statewindowcurrent][stateid],flipLUHgrids);
+          }
+          statewindowyearindex[statewindowcurrent] = yearindex;
+      }
+  }
+  
+  for (stateid = 0; stateid < MAXSTATEWINDOW; stateid++) {
+      *statewindowcurrGrid[stateid] = inSTATEWINDOWGrid[statewindowcurrent][stateid];
+  }
+  
+  blockreading = 0;
+  closencinputfile();
 
   return 0;
   
@@ -2340,8 +5500,10 @@ int readLUHcurrstateGrids(int currentyear) {
 
 int readLUHprevdeltastateGrids(int prevyear) {
 
-  int pftid, cftid, curryear, yearindex1, yearindex2;
+  int pftid, cftid, curryear, yearindex1, yearindex2, stateid;
   long ctsmlin, ctsmpix;
+  float *prevGrid, *currGrid, *deltaGrid;
+  int luhstatesopen = 0;
   
   if (prevyear == luhprevstatesreadyear) {
       return 0;
@@ -2383,99 +5545,50 @@ int readLUHprevdeltastateGrids(int prevyear) {
       }
   }
     
-  openncinputfile(luhstatesdb); 
-
-  readnc3dfield("secdf",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("secdf",yearindex2,inPREVDELTASECDFGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTASECDFGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTASECDFGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("secdn",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("secdn",yearindex2,inPREVDELTASECDNGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTASECDNGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTASECDNGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("pastr",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("pastr",yearindex2,inPREVDELTAPASTRGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTAPASTRGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTAPASTRGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
+  for (stateid = 0; stateid < MAXSTATEWINDOW; stateid++) {
 
-  readnc3dfield("range",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("range",yearindex2,inPREVDELTARANGEGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTARANGEGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTARANGEGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c3ann",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("c3ann",yearindex2,inPREVDELTAC3ANNGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTAC3ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTAC3ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
+      /* Both years come from the rolling window when held there, otherwise from the file */
 
-  readnc3dfield("c4ann",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("c4ann",yearindex2,inPREVDELTAC4ANNGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTAC4ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTAC4ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
+      prevGrid = findstatewindowGrid(stateid,yearindex1);
+      if (prevGrid == NULL) {
+          if (luhstatesopen == 0) {
+              openncinputfile(luhstatesdb);
+              blockreading = 1;
+              luhstatesopen = 1;
+          }
+          readnc3dfield(statewindowname[stateid],yearindex1,tempGrid,flipLUHgrids);
+          prevGrid = tempGrid;
       }
-  }
-
-  readnc3dfield("c3per",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("c3per",yearindex2,inPREVDELTAC3PERGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTAC3PERGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTAC3PERGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
+      
+      deltaGrid = *statewindowdeltaGrid[stateid];
+      currGrid = findstatewindowGrid(stateid,yearindex2);
+      if (currGrid == NULL) {
+          if (luhstatesopen == 0) {
+              openncinputfile(luhstatesdb);
+              blockreading = 1;
+              luhstatesopen = 1;
+          }
+          readnc3dfield(statewindowname[stateid],yearindex2,deltaGrid,flipLUHgrids);
+          currGrid = deltaGrid;
       }
-  }
-
-  readnc3dfield("c4per",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("c4per",yearindex2,inPREVDELTAC4PERGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTAC4PERGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTAC4PERGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
+      
+      for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+          for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+              if (prevGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
+                  deltaGrid[ctsmlin * MAXOUTPIX + ctsmpix] = currGrid[ctsmlin * MAXOUTPIX + ctsmpix] - prevGrid[ctsmlin * MAXOUTPIX + ctsmpix];
+	      }
+              else {
+                  deltaGrid[ctsmlin * MAXOUTPIX + ctsmpix] = currGrid[ctsmlin * MAXOUTPIX + ctsmpix];
+              }
+          }
       }
-  }
 
-  readnc3dfield("c3nfx",yearindex1,tempGrid,flipLUHgrids);
-  readnc3dfield("c3nfx",yearindex2,inPREVDELTAC3NFXGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              inPREVDELTAC3NFXGrid[ctsmlin * MAXOUTPIX + ctsmpix] = inPREVDELTAC3NFXGrid[ctsmlin * MAXOUTPIX + ctsmpix] - tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
   }
   
-  closencfile();
+  if (luhstatesopen == 1) {
+      blockreading = 0;
+      closencinputfile();
+  }
 
   return 0;
   
@@ -2514,6 +5627,7 @@ int readLUHwoodharvestGrids(int prevyear) {
   }
   
   openncinputfile(luhtransitionsdb); 
+  blockreading = 1;
   
   readnc3dfield("primf_harv",yearindex,inHARVESTVH1Grid,flipLUHgrids);
   readnc3dfield("primn_harv",yearindex,inHARVESTVH2Grid,flipLUHgrids);
@@ -2526,7 +5640,8 @@ int readLUHwoodharvestGrids(int prevyear) {
   readnc3dfield("secyf_bioh",yearindex,inBIOHSH2Grid,flipLUHgrids);
   readnc3dfield("secnf_bioh",yearindex,inBIOHSH3Grid,flipLUHgrids);
   
-  closencfile();
+  blockreading = 0;
+  closencinputfile();
   
   return 0;
   
@@ -2563,150 +5678,37 @@ int readUNREPSECDFGrids(int prevyear) {
 	  luhsecdfunrepreadyear = luhtransitionsendyear;
       }
       else {
-          yearindex = prevyear - luhtransitionsstartyear;
-	  luhsecdfunrepreadyear = prevyear;
-      }
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-
-  readnc3dfield("c3ann_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-	  else {
-	      secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
-	  }
-      }
-  }
-
-  readnc3dfield("c4ann_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c3per_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c4per_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c3nfx_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("primf_harv",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-	  else {
-              secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
-	  }
-      }
-  }
-
-  readnc3dfield("secdn_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("pastr_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("range_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("urban_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("secdf_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-	  else {
-              secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
-	  }
-      }
-  }
-
-  readnc3dfield("secdf_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("secdf_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
+          yearindex = prevyear - luhtransitionsstartyear;
+	  luhsecdfunrepreadyear = prevyear;
       }
   }
+  
+  openncinputfile(luhtransitionsdb); 
 
-  readnc3dfield("secdf_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdfOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
+  accumulatenc3dfield("c3ann_to_secdf",yearindex,secdfCROPINGrid,1,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c4ann_to_secdf",yearindex,secdfCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c3per_to_secdf",yearindex,secdfCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c4per_to_secdf",yearindex,secdfCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c3nfx_to_secdf",yearindex,secdfCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
 
+  accumulatenc3dfield("primf_harv",yearindex,secdfOTHERINGrid,1,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdn_to_secdf",yearindex,secdfOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("pastr_to_secdf",yearindex,secdfOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("range_to_secdf",yearindex,secdfOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("urban_to_secdf",yearindex,secdfOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
 
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  accumulatenc3dfield("secdf_to_secdn",yearindex,secdfOTHEROUTGrid,1,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdf_to_pastr",yearindex,secdfOTHEROUTGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdf_to_range",yearindex,secdfOTHEROUTGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdf_to_urban",yearindex,secdfOTHEROUTGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+
+
+  /* Rows outside the tropics are zero, only the tropical rows were read above */
+  
+  memset(inUNREPSECDFGrid,0,tropicfirstlin * MAXOUTPIX * sizeof(float));
+  memset(&inUNREPSECDFGrid[tropicendlin * MAXOUTPIX],0,(MAXOUTLIN - tropicendlin) * MAXOUTPIX * sizeof(float));
+
+  for (ctsmlin = tropicfirstlin; ctsmlin < tropicendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
 	  cropstatechange = inPREVDELTAC3ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix];
 	  cropstatechange += inPREVDELTAC4ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix];
@@ -2739,7 +5741,7 @@ int readUNREPSECDFGrids(int prevyear) {
       }
   }
   
-  closencfile();
+  closencinputfile();
 
   return 0;
   
@@ -2783,143 +5785,30 @@ int readUNREPSECDNGrids(int prevyear) {
   
   openncinputfile(luhtransitionsdb); 
   
-  readnc3dfield("c3ann_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-	  else {
-	      secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
-	  }
-      }
-  }
-
-  readnc3dfield("c4ann_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c3per_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c4per_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("c3nfx_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnCROPINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("primn_harv",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-	  else {
-              secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
-	  }
-      }
-  }
-
-  readnc3dfield("secdf_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("pastr_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("range_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("urban_to_secdn",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHERINGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
-
-  readnc3dfield("secdn_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-	  else {
-              secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
-	  }
-      }
-  }
+  accumulatenc3dfield("c3ann_to_secdn",yearindex,secdnCROPINGrid,1,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c4ann_to_secdn",yearindex,secdnCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c3per_to_secdn",yearindex,secdnCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c4per_to_secdn",yearindex,secdnCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("c3nfx_to_secdn",yearindex,secdnCROPINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
 
-  readnc3dfield("secdn_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
+  accumulatenc3dfield("primn_harv",yearindex,secdnOTHERINGrid,1,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdf_to_secdn",yearindex,secdnOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("pastr_to_secdn",yearindex,secdnOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("range_to_secdn",yearindex,secdnOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("urban_to_secdn",yearindex,secdnOTHERINGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
 
-  readnc3dfield("secdn_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
+  accumulatenc3dfield("secdn_to_secdf",yearindex,secdnOTHEROUTGrid,1,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdn_to_pastr",yearindex,secdnOTHEROUTGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdn_to_range",yearindex,secdnOTHEROUTGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
+  accumulatenc3dfield("secdn_to_urban",yearindex,secdnOTHEROUTGrid,0,tropicfirstlin,tropicendlin,flipLUHgrids);
 
-  readnc3dfield("secdn_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          if (tempGrid[ctsmlin * MAXOUTPIX + ctsmpix] <= 1.0) {
-              secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] = secdnOTHEROUTGrid[ctsmlin * MAXOUTPIX + ctsmpix] + tempGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-	  }
-      }
-  }
 
+  /* Rows outside the tropics are zero, only the tropical rows were read above */
+  
+  memset(inUNREPSECDNGrid,0,tropicfirstlin * MAXOUTPIX * sizeof(float));
+  memset(&inUNREPSECDNGrid[tropicendlin * MAXOUTPIX],0,(MAXOUTLIN - tropicendlin) * MAXOUTPIX * sizeof(float));
 
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  for (ctsmlin = tropicfirstlin; ctsmlin < tropicendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
 	  cropstatechange = inPREVDELTAC3ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix];
 	  cropstatechange += inPREVDELTAC4ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix];
@@ -2952,7 +5841,7 @@ int readUNREPSECDNGrids(int prevyear) {
       }
   }
 
-  closencfile();
+  closencinputfile();
   
   return 0;
   
@@ -2992,6 +5881,7 @@ int readLUHcropmanagementGrids(int currentyear) {
   }
   
   openncinputfile(luhmanagementdb); 
+  blockreading = 1;
   
   readnc3dfield("irrig_c3ann",yearindex,inIRRIGC3ANNGrid,flipLUHgrids);
   readnc3dfield("irrig_c4ann",yearindex,inIRRIGC4ANNGrid,flipLUHgrids);
@@ -3005,87 +5895,123 @@ int readLUHcropmanagementGrids(int currentyear) {
   readnc3dfield("fertl_c4per",yearindex,inFERTC4PERGrid,flipLUHgrids);
   readnc3dfield("fertl_c3nfx",yearindex,inFERTC3NFXGrid,flipLUHgrids);
 
-  closencfile();
+  blockreading = 0;
+  closencinputfile();
 
   return 0;
   
 }
 
 
-int extrapindvidualfertGrid(float *cropgrid, float *fertgrid) {
+int extrapallfertGrids(float *cropgrid[MAXCROPTYPE], float *fertgrid[MAXCROPTYPE], char *dirtygrid) {
 
   long ctsmlin, ctsmpix;
   long searchlin, searchpix;
   long searchboxinside, searchboxoutside;
-  float allcropfraction, cropfraction, searchcrop, searchfert, searchcropsum, searchfertsum;
-  int searchlinokay, searchpixokay;
+  float allcropfraction, cropfraction, searchcrop, searchfert;
+  float searchcropsum[MAXCROPTYPE], searchfertsum[MAXCROPTYPE];
+  int croptype, searchcount, searchtype[MAXCROPTYPE];
+  int searchring;
+  long searchvisits;
   
+  /* One traversal extrapolates all crop types: each type keeps its own accumulator and */
+  /* stops expanding its search box as soon as it finds crop, the others keep going     */
+  /* Results go to tempextrapGrid, cells not flagged in dirtygrid keep their old values */
+
   for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
 
-          tempextrapGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
+          if (dirtygrid != NULL && dirtygrid[ctsmlin * MAXOUTPIX + ctsmpix] == 0) {
+              continue;
+          }
+
+          for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+              tempextrapGrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix] = 0.0;
+          }
+          extrapcellcount++;
 	  
 	  allcropfraction = inCURRC3ANNGrid[ctsmlin * MAXOUTPIX + ctsmpix];
       
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1 && allcropfraction >= 0.0 && allcropfraction <= 1.0) {
-	      cropfraction = cropgrid[ctsmlin * MAXOUTPIX + ctsmpix];
-              if (cropfraction > 0.0 && cropfraction <= 1.0) {
-	          tempextrapGrid[ctsmlin * MAXOUTPIX + ctsmpix] = fertgrid[ctsmlin * MAXOUTPIX + ctsmpix];
+              searchcount = 0;
+              for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+	          cropfraction = cropgrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix];
+                  if (cropfraction > 0.0 && cropfraction <= 1.0) {
+	              tempextrapGrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix] = fertgrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix];
+                      searchtype[croptype] = 0;
+                      extrapdirectcount[croptype]++;
+                  }
+                  else {
+                      searchcropsum[croptype] = 0.0;
+                      searchfertsum[croptype] = 0.0;
+                      searchtype[croptype] = 1;
+                      searchcount++;
+                  }
               }
-	      else {
-	          searchcropsum = 0.0;
-		  searchfertsum = 0.0;
-		  searchboxinside = 0;
-		  searchboxoutside = 2;
-		  while (searchcropsum == 0.0) {
-                      for (searchlin = ctsmlin - searchboxoutside; searchlin <= ctsmlin + searchboxoutside; searchlin++) {
-                          searchlinokay = 1;
-	                  if (searchlin < 0 || searchlin >= MAXOUTLIN) {
-                              searchlinokay = 0;
+	      searchboxinside = 0;
+	      searchboxoutside = 2;
+	      searchring = 0;
+	      while (searchcount > 0) {
+                  searchvisits = 0;
+                  for (searchlin = ctsmlin - searchboxoutside; searchlin <= ctsmlin + searchboxoutside; searchlin++) {
+                      if (searchlin < 0 || searchlin >= MAXOUTLIN) {
+                          continue;
+                      }
+                      if (searchlin >= ctsmlin - searchboxinside && searchlin <= ctsmlin + searchboxinside) {
+                          continue;
+                      }
+                      for (searchpix = ctsmpix - searchboxoutside; searchpix <= ctsmpix + searchboxoutside; searchpix++) {
+                          if (searchpix < 0 || searchpix >= MAXOUTPIX) {
+                              continue;
                           }
-                          if (searchlin >= ctsmlin - searchboxinside && searchlin <= ctsmlin + searchboxinside) {
-                              searchlinokay = 0;
+                          if (searchpix >= ctsmpix - searchboxinside && searchpix <= ctsmpix + searchboxinside) {
+                              continue;
                           }
-                          if (searchlinokay == 1) {
-                              for (searchpix = ctsmpix - searchboxoutside; searchpix <= ctsmpix + searchboxoutside; searchpix++) {
-                                  searchpixokay = 1;
-	                          if (searchpix < 0 || searchpix >= MAXOUTPIX) {
-                                      searchpixokay = 0;
-                                  }
-                                  if (searchpix >= ctsmpix - searchboxinside && searchpix <= ctsmpix + searchboxinside) {
-                                      searchpixokay = 0;
-                                  }
-                                  if (searchpixokay) {
-                                      searchcrop = cropgrid[searchlin * MAXOUTPIX + searchpix];
-                                      if (searchcrop > 0.0 && searchcrop <= 1.0) {
-                                          searchfert = fertgrid[searchlin * MAXOUTPIX + searchpix];
-                                          if (searchfert >= 0.0 && searchfert < 10000.0) {
-                                              searchcropsum += searchcrop;
-                                              searchfertsum += searchcrop * searchfert;
-                                          }
+                          searchvisits++;
+                          for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+                              if (searchtype[croptype] == 1) {
+                                  searchcrop = cropgrid[croptype][searchlin * MAXOUTPIX + searchpix];
+                                  if (searchcrop > 0.0 && searchcrop <= 1.0) {
+                                      searchfert = fertgrid[croptype][searchlin * MAXOUTPIX + searchpix];
+                                      if (searchfert >= 0.0 && searchfert < 10000.0) {
+                                          searchcropsum[croptype] += searchcrop;
+                                          searchfertsum[croptype] += searchcrop * searchfert;
                                       }
                                   }
                               }
                           }
                       }
-		      searchboxinside = searchboxoutside;
-		      searchboxoutside = searchboxoutside * 2; 
-                      if (searchboxoutside > 16) {
-		          searchfertsum = fertgrid[ctsmlin * MAXOUTPIX + ctsmpix];
-		          searchcropsum = 1.0;
+                  }
+		  searchboxinside = searchboxoutside;
+		  searchboxoutside = searchboxoutside * 2; 
+                  for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+                      if (searchtype[croptype] == 1) {
+                          extrapvisitcount[croptype] += searchvisits;
+                          if (searchcropsum[croptype] != 0.0) {
+                              extrapringcount[croptype][searchring]++;
+                          }
+                          else if (searchboxoutside > MAXEXTRAPSEARCH) {
+                              extrapfallbackcount[croptype]++;
+                          }
+                          if (searchboxoutside > MAXEXTRAPSEARCH) {
+		              searchfertsum[croptype] = fertgrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix];
+		              searchcropsum[croptype] = 1.0;
+                          }
+                          if (searchcropsum[croptype] != 0.0) {
+                              tempextrapGrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix] = searchfertsum[croptype] / searchcropsum[croptype];
+                              searchtype[croptype] = 0;
+                              searchcount--;
+                              if (searchring >= 2) {
+                                  extrapHEATGrid[(ctsmlin / EXTRAPHEATBLOCK) * extrapheatpix + ctsmpix / EXTRAPHEATBLOCK]++;
+                              }
+                          }
                       }
-		  }
-                  tempextrapGrid[ctsmlin * MAXOUTPIX + ctsmpix] = searchfertsum / searchcropsum;		      
-              }
+                  }
+                  searchring++;
+	      }
           }
       }
   }
-  
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
-      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
-          fertgrid[ctsmlin * MAXOUTPIX + ctsmpix] = tempextrapGrid[ctsmlin * MAXOUTPIX + ctsmpix];
-      }
-  }
 
   return 0;
 
@@ -3095,7 +6021,28 @@ int extrapindvidualfertGrid(float *cropgrid, float *fertgrid) {
 int extrapfertGrids() {
 
   long ctsmlin, ctsmpix;
+  long searchlin1, searchlin2, searchpix1, searchpix2, changecount;
   float allcropfraction;
+  float *cropgrid[MAXCROPTYPE] = {inCURRC3ANNGrid, inCURRC4ANNGrid, inCURRC3PERGrid, inCURRC4PERGrid, inCURRC3NFXGrid};
+  float *fertgrid[MAXCROPTYPE] = {inFERTC3ANNGrid, inFERTC4ANNGrid, inFERTC3PERGrid, inFERTC4PERGrid, inFERTC3NFXGrid};
+  int croptype, changed, searchring;
+  struct timespec extrapstart, extrapend;
+
+  clock_gettime(CLOCK_MONOTONIC,&extrapstart);
+  
+  extrapcellcount = 0;
+  extrapseconds = 0.0;
+  for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+      extrapdirectcount[croptype] = 0;
+      extrapfallbackcount[croptype] = 0;
+      extrapvisitcount[croptype] = 0;
+      for (searchring = 0; searchring < MAXEXTRAPRING; searchring++) {
+          extrapringcount[croptype][searchring] = 0;
+      }
+  }
+  for (ctsmlin = 0; ctsmlin < extrapheatlin * extrapheatpix; ctsmlin++) {
+      extrapHEATGrid[ctsmlin] = 0;
+  }
 
   for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
@@ -3115,11 +6062,80 @@ int extrapfertGrids() {
       }
   }
   
-  extrapindvidualfertGrid(inCURRC3ANNGrid,inFERTC3ANNGrid);
-  extrapindvidualfertGrid(inCURRC4ANNGrid,inFERTC4ANNGrid);
-  extrapindvidualfertGrid(inCURRC3PERGrid,inFERTC3PERGrid);
-  extrapindvidualfertGrid(inCURRC4PERGrid,inFERTC4PERGrid);
-  extrapindvidualfertGrid(inCURRC3NFXGrid,inFERTC3NFXGrid);
+  /* The extrapolated grids from the previous year are kept in tempextrapGrid together with the */
+  /* crop states and fertilizer they were built from (extrapCROPGrid and extrapFERTGrid). When  */
+  /* readLUHcropmanagementGrids returned early inFERT holds last year's result, which is        */
+  /* extrapolated again as before.                                                               */
+  
+  changecount = 0;
+  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          changed = 1 - extrapcachevalid;
+          for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+              if (cropgrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix] != extrapCROPGrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix]) {
+                  changed = 1;
+              }
+              if (fertgrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix] != extrapFERTGrid[croptype][ctsmlin * MAXOUTPIX + ctsmpix]) {
+                  changed = 1;
+              }
+          }
+          extrapCHANGEGrid[ctsmlin * MAXOUTPIX + ctsmpix] = changed;
+          changecount += changed;
+      }
+  }
+
+  if (changecount == 0) {
+      for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+          memcpy(fertgrid[croptype],tempextrapGrid[croptype],OUTDATASIZE);
+      }
+      clock_gettime(CLOCK_MONOTONIC,&extrapend);
+      extrapseconds = (extrapend.tv_sec - extrapstart.tv_sec) + 1.0e-9 * (extrapend.tv_nsec - extrapstart.tv_nsec);
+      return 0;
+  }
+  
+  for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+      memcpy(extrapCROPGrid[croptype],cropgrid[croptype],OUTDATASIZE);
+      memcpy(extrapFERTGrid[croptype],fertgrid[croptype],OUTDATASIZE);
+  }
+
+  /* A cell has to be redone when any input within its search box changed: dilate the change */
+  /* mask by MAXEXTRAPSEARCH cells using a summed area table of the changed cells             */
+
+  for (ctsmpix = 0; ctsmpix <= MAXOUTPIX; ctsmpix++) {
+      extrapCHANGESUMGrid[ctsmpix] = 0;
+  }
+  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+      extrapCHANGESUMGrid[(ctsmlin + 1) * (MAXOUTPIX + 1)] = 0;
+      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          extrapCHANGESUMGrid[(ctsmlin + 1) * (MAXOUTPIX + 1) + ctsmpix + 1] = extrapCHANGEGrid[ctsmlin * MAXOUTPIX + ctsmpix]
+              + extrapCHANGESUMGrid[ctsmlin * (MAXOUTPIX + 1) + ctsmpix + 1]
+              + extrapCHANGESUMGrid[(ctsmlin + 1) * (MAXOUTPIX + 1) + ctsmpix]
+              - extrapCHANGESUMGrid[ctsmlin * (MAXOUTPIX + 1) + ctsmpix];
+      }
+  }
+
+  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+      searchlin1 = ctsmlin - MAXEXTRAPSEARCH < 0 ? 0 : ctsmlin - MAXEXTRAPSEARCH;
+      searchlin2 = ctsmlin + MAXEXTRAPSEARCH + 1 > MAXOUTLIN ? MAXOUTLIN : ctsmlin + MAXEXTRAPSEARCH + 1;
+      for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          searchpix1 = ctsmpix - MAXEXTRAPSEARCH < 0 ? 0 : ctsmpix - MAXEXTRAPSEARCH;
+          searchpix2 = ctsmpix + MAXEXTRAPSEARCH + 1 > MAXOUTPIX ? MAXOUTPIX : ctsmpix + MAXEXTRAPSEARCH + 1;
+          changed = (extrapCHANGESUMGrid[searchlin2 * (MAXOUTPIX + 1) + searchpix2] - extrapCHANGESUMGrid[searchlin1 * (MAXOUTPIX + 1) + searchpix2]
+              - extrapCHANGESUMGrid[searchlin2 * (MAXOUTPIX + 1) + searchpix1] + extrapCHANGESUMGrid[searchlin1 * (MAXOUTPIX + 1) + searchpix1]) > 0;
+          extrapCHANGEGrid[ctsmlin * MAXOUTPIX + ctsmpix] = changed;
+      }
+  }
+  
+  extrapallfertGrids(extrapCROPGrid,extrapFERTGrid,extrapCHANGEGrid);
+
+  for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+      memcpy(fertgrid[croptype],tempextrapGrid[croptype],OUTDATASIZE);
+  }
+  
+  extrapcachevalid = 1;
+  
+  clock_gettime(CLOCK_MONOTONIC,&extrapend);
+  extrapseconds = (extrapend.tv_sec - extrapstart.tv_sec) + 1.0e-9 * (extrapend.tv_nsec - extrapstart.tv_nsec);
   
   return 0;
   
@@ -3127,6 +6143,55 @@ int extrapfertGrids() {
 
 
 
+int writeextrapstats(int currentyear) {
+
+  FILE *extrapstatsoutfile;
+  int croptype, searchring;
+  long heatlin, heatpix;
+  
+  if (extrapstats == 0) {
+      return 0;
+  }
+  
+  extrapstatsoutfile = fopen(extrapstatsfile,"a");
+  if (extrapstatsoutfile == NULL) {
+      printf("Cannot open %s\n",extrapstatsfile);
+      extrapstats = 0;
+      return 1;
+  }
+  
+  /* Histogram of the ring radius each searching cell first found crop at. Cells reaching the */
+  /* 16 cell ring keep their own value whether they found crop there (Ring16) or not          */
+  /* (Fallback). The time covers all crop types and rings of the year together.                */
+
+  fprintf(extrapstatsoutfile,"Year %d extrapolation %.3f seconds for all types and rings, cells searched %ld of %ld\n",currentyear,extrapseconds,extrapcellcount,MAXOUTLIN * MAXOUTPIX);
+  fprintf(extrapstatsoutfile,"%-8s %10s %10s %10s %10s %10s %10s %14s\n","Type","Direct","Ring2","Ring4","Ring8","Ring16","Fallback","CellsVisited");
+  for (croptype = 0; croptype < MAXCROPTYPE; croptype++) {
+      fprintf(extrapstatsoutfile,"%-8s %10ld",extrapcropname[croptype],extrapdirectcount[croptype]);
+      for (searchring = 0; searchring < MAXEXTRAPRING; searchring++) {
+          fprintf(extrapstatsoutfile," %10ld",extrapringcount[croptype][searchring]);
+      }
+      fprintf(extrapstatsoutfile," %10ld %14ld\n",extrapfallbackcount[croptype],extrapvisitcount[croptype]);
+  }
+
+  /* Coarse heat map of deep searches (ring 8 and beyond, all crop types), north row first */
+
+  fprintf(extrapstatsoutfile,"Deep search heat map %ld x %ld blocks of %d cells\n",extrapheatlin,extrapheatpix,EXTRAPHEATBLOCK);
+  for (heatlin = extrapheatlin - 1; heatlin >= 0; heatlin--) {
+      for (heatpix = 0; heatpix < extrapheatpix; heatpix++) {
+          fprintf(extrapstatsoutfile," %ld",extrapHEATGrid[heatlin * extrapheatpix + heatpix]);
+      }
+      fprintf(extrapstatsoutfile,"\n");
+  }
+  fprintf(extrapstatsoutfile,"\n");
+  
+  fclose(extrapstatsoutfile);
+  
+  return 0;
+  
+}
+
+
 int generateLUHcollectionGrids() {
 
   long ctsmlin, ctsmpix;
@@ -3239,8 +6304,14 @@ int generatectsmURBANGrids() {
   float pctglacierval, pctlakeval, pctwetlandval, pctavail;
   float pcturbanval;
 
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  /* Tiles without land are left as initialized, generatedblGrids fills them as ocean */
+  
+  for (ctsmlin = landfirstlin; ctsmlin < landendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              ctsmpix += LANDTILESIZE - 1 - ctsmpix % LANDTILESIZE;
+              continue;
+          }
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1.0) {
               pctglacierval = inPCTGLACIERGrid[ctsmlin * MAXOUTPIX + ctsmpix];
               pctlakeval = inPCTLAKEGrid[ctsmlin * MAXOUTPIX + ctsmpix];
@@ -3275,8 +6346,12 @@ int generatectsmPFTGrids() {
   float forestunrepfrac, otherunrepfrac;
   float newpctpft, unrepfrac, newpctpfttotal;
   
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  for (ctsmlin = landfirstlin; ctsmlin < landendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              ctsmpix += LANDTILESIZE - 1 - ctsmpix % LANDTILESIZE;
+              continue;
+          }
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1) {
               pctnatvegval = inCURRNATVEGGrid[ctsmlin * MAXOUTPIX + ctsmpix] * 100.0;
               forestunrepfrac = 0.0;
@@ -3408,8 +6483,12 @@ int generatectsmCFTGrids() {
   float newpctrainfedcft, newpctirrigcft, newunreprainfedval, newunrepirrigval;
   float newpctcroptotal, newpctcft;
 
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  for (ctsmlin = landfirstlin; ctsmlin < landendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              ctsmpix += LANDTILESIZE - 1 - ctsmpix % LANDTILESIZE;
+              continue;
+          }
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1) {
               pctcropval = inCURRCROPTOTALGrid[ctsmlin * MAXOUTPIX + ctsmpix] * 100.0;
               if (pctcropval > 0.0 && pctcropval <= 100.0) {
@@ -3526,8 +6605,12 @@ int generatectsmwoodharvestGrids() {
   float newharvestvh1, newharvestvh2, newharvestsh1, newharvestsh2, newharvestsh3;
   float newbiohvh1, newbiohvh2, newbiohsh1, newbiohsh2, newbiohsh3;
 
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  for (ctsmlin = landfirstlin; ctsmlin < landendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              ctsmpix += LANDTILESIZE - 1 - ctsmpix % LANDTILESIZE;
+              continue;
+          }
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1.0) {
               TreePFTArea = 0.0;
               TreeFrac = 0.0;
@@ -3672,8 +6755,12 @@ int generatectsmfertGrids() {
   float pctcropval, pctrainfedcft, pctirrigcft;
   float fertamount;
 
-  for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
+  for (ctsmlin = landfirstlin; ctsmlin < landendlin; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              ctsmpix += LANDTILESIZE - 1 - ctsmpix % LANDTILESIZE;
+              continue;
+          }
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1) {
               for (rawcftid = 0; rawcftid < MAXCFTRAW; rawcftid++) {
                   rainfedcftid = 2 * (rawcftid);
@@ -3739,9 +6826,87 @@ double truncCTSMValues(double CTSMValueIn, double CTSMMaxValue, double CTSMThres
 }
 
 
+int setdblspan(double *grid, long firstcell, long cellcount, double value) {
+
+  long cellindex;
+
+  for (cellindex = firstcell; cellindex < firstcell + cellcount; cellindex++) {
+      grid[cellindex] = value;
+  }
+
+  return 0;
+
+}
+
+int filloceanspan(long firstcell, long cellcount) {
+
+  long cellindex;
+  int pftid, cftid;
+
+  /* Same values generatedblGrids gives a cell off the land mask */
+  
+  for (cellindex = firstcell; cellindex < firstcell + cellcount; cellindex++) {
+      outAREAdblGrid[cellindex] = truncCTSMValues(inAREAGrid[cellindex],1000000.0,0.001);
+      outLANDMASKGrid[cellindex] = 0.0;
+  }
+  setdblspan(outLANDFRACdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTGLACIERdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTLAKEdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTWETLANDdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTURBANdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTCROPdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTNATVEGdblGrid,firstcell,cellcount,0.0);
+  for (pftid = 0; pftid < MAXPFT; pftid++) {
+      setdblspan(outPCTPFTdblGrid[pftid],firstcell,cellcount,0.0);
+      setdblspan(outUNREPPFTdblGrid[pftid],firstcell,cellcount,0.0);
+  }
+  for (cftid = 0; cftid < MAXCFT; cftid++) {
+      setdblspan(outPCTCFTdblGrid[cftid],firstcell,cellcount,0.0);
+      setdblspan(outFERTNITROdblGrid[cftid],firstcell,cellcount,0.0);
+      setdblspan(outUNREPCFTdblGrid[cftid],firstcell,cellcount,0.0);
+  }
+  setdblspan(outRBIOHVH1dblGrid,firstcell,cellcount,0.0);
+  setdblspan(outRBIOHVH2dblGrid,firstcell,cellcount,0.0);
+  setdblspan(outRBIOHSH1dblGrid,firstcell,cellcount,0.0);
+  setdblspan(outRBIOHSH2dblGrid,firstcell,cellcount,0.0);
+  setdblspan(outRBIOHSH3dblGrid,firstcell,cellcount,0.0);
+
+  return 0;
+
+}
+
+int swapoceanspan(long firstcell, long cellcount) {
+
+  long cellindex;
+  int pftid, cftid;
+
+  /* Same values swapoceanGrids gives a cell filled as ocean by filloceanspan */
+  
+  for (cellindex = firstcell; cellindex < firstcell + cellcount; cellindex++) {
+      outLANDMASKGrid[cellindex] = 1.0;
+  }
+  setdblspan(outLANDFRACdblGrid,firstcell,cellcount,1.0);
+  setdblspan(outPCTLAKEdblGrid,firstcell,cellcount,100.0);
+  setdblspan(outPCTCROPdblGrid,firstcell,cellcount,0.0);
+  setdblspan(outPCTPFTdblGrid[0],firstcell,cellcount,100.0);
+  for (pftid = 1; pftid < MAXPFT; pftid++) {
+      setdblspan(outPCTPFTdblGrid[pftid],firstcell,cellcount,0.0);
+  }
+  setdblspan(outPCTCFTdblGrid[0],firstcell,cellcount,100.0);
+  for (cftid = 1; cftid < MAXCFT; cftid++) {
+      setdblspan(outPCTCFTdblGrid[cftid],firstcell,cellcount,0.0);
+  }
+  for (cftid = 0; cftid < MAXCFT; cftid++) {
+      setdblspan(outFERTNITROdblGrid[cftid],firstcell,cellcount,0.0);
+  }
+
+  return 0;
+
+}
+
 int generatedblGrids() {
 
-  long ctsmlin, ctsmpix;
+  long ctsmlin, ctsmpix, tileendpix;
   int pftid, cftid;
   double LandFRAC, AvailPCT, OtherPCT, AllPFTs, AllCFTs, CropPCT, NatVegPCT, tempdblPCT;
   double LargestPCTPFT, RescaledPCTPFT, LargestPCTCFT, RescaledPCTCFT;
@@ -3749,6 +6914,15 @@ int generatedblGrids() {
   
   for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              tileendpix = (ctsmpix / LANDTILESIZE + 1) * LANDTILESIZE;
+              if (tileendpix > MAXOUTPIX) {
+                  tileendpix = MAXOUTPIX;
+              }
+              filloceanspan(ctsmlin * MAXOUTPIX + ctsmpix,tileendpix - ctsmpix);
+              ctsmpix = tileendpix - 1;
+              continue;
+          }
           outAREAdblGrid[ctsmlin * MAXOUTPIX + ctsmpix] = truncCTSMValues(inAREAGrid[ctsmlin * MAXOUTPIX + ctsmpix],1000000.0,0.001);
           if (inLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 1.0) {
               outLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 1.0;
@@ -3913,11 +7087,20 @@ int generatedblGrids() {
 int swapoceanGrids() {
 
   double scalelandunits;
-  long ctsmlin, ctsmpix;
+  long ctsmlin, ctsmpix, tileendpix;
   int pftid, cftid;
   
   for (ctsmlin = 0; ctsmlin < MAXOUTLIN; ctsmlin++) {
       for (ctsmpix = 0; ctsmpix < MAXOUTPIX; ctsmpix++) {
+          if (landtileGrid[(ctsmlin / LANDTILESIZE) * landtilepix + ctsmpix / LANDTILESIZE] == 0) {
+              tileendpix = (ctsmpix / LANDTILESIZE + 1) * LANDTILESIZE;
+              if (tileendpix > MAXOUTPIX) {
+                  tileendpix = MAXOUTPIX;
+              }
+              swapoceanspan(ctsmlin * MAXOUTPIX + ctsmpix,tileendpix - ctsmpix);
+              ctsmpix = tileendpix - 1;
+              continue;
+          }
           if (outLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] == 0.0) {
               outLANDMASKGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 1.0;
 	      outLANDFRACdblGrid[ctsmlin * MAXOUTPIX + ctsmpix] = 1.0;
@@ -3957,59 +7140,47 @@ int writegrids(int currentyear) {
 
   char outncfilename[1024];
   long ctsmlin, ctsmpix;
-  int pftid, cftid;
   char pftidstr[256];
   char cftidstr[256];
 
   sprintf(outncfilename,"%s/%s_%d.%s.nc",outputdir,outputseries,currentyear,timestamp);
   createncoutputfile(outncfilename);
-  openncoutputfile(outncfilename);
-  
-  writenc1dintfield("natpft",innatpft);
-  writenc1dintfield("cft",incft);
-  writenc0dfield("EDGEN",&inEDGEN);
-  writenc0dfield("EDGEE",&inEDGEE);
-  writenc0dfield("EDGES",&inEDGES);
-  writenc0dfield("EDGEW",&inEDGEW);
-  writenc1dfield("LAT",inLAT);
-  writenc2dfield("LATIXY",inLATIXY);
-  writenc1dfield("LON",inLON);
-  writenc2dfield("LONGXY",inLONGXY);
-  writenc2dfield("LANDMASK",outLANDMASKGrid);
-  writenc2ddblfield("LANDFRAC",outLANDFRACdblGrid);
-  writenc2ddblfield("AREA",outAREAdblGrid);
-  writenc2ddblfield("PCT_GLACIER",outPCTGLACIERdblGrid);
-  writenc2ddblfield("PCT_LAKE",outPCTLAKEdblGrid);
-  writenc2ddblfield("PCT_WETLAND",outPCTWETLANDdblGrid);
-  writenc2ddblfield("PCT_URBAN",outPCTURBANdblGrid);
-  writenc2ddblfield("PCT_NATVEG",outPCTNATVEGdblGrid);
-  writenc2ddblfield("PCT_CROP",outPCTCROPdblGrid);
   
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      writenc3ddblfield("PCT_NAT_PFT",pftid,outPCTPFTdblGrid[pftid]);
-  }
-  
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      writenc3ddblfield("PCT_CFT",cftid,outPCTCFTdblGrid[cftid]);
-  }
-
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      writenc3ddblfield("FERTNITRO_CFT",cftid,outFERTNITROdblGrid[cftid]);
-  }
-
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      writenc3ddblfield("UNREPRESENTED_PFT_LULCC",pftid,outUNREPPFTdblGrid[pftid]);
-  }
-  
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      writenc3ddblfield("UNREPRESENTED_CFT_LULCC",cftid,outUNREPCFTdblGrid[cftid]);
-  }
-
-  writenc2ddblfield("HARVEST_VH1",outRBIOHVH1dblGrid);
-  writenc2ddblfield("HARVEST_VH2",outRBIOHVH2dblGrid);
-  writenc2ddblfield("HARVEST_SH1",outRBIOHSH1dblGrid);
-  writenc2ddblfield("HARVEST_SH2",outRBIOHSH2dblGrid);
-  writenc2ddblfield("HARVEST_SH3",outRBIOHSH3dblGrid);
+  /* Variables are written in the order they were defined so the file is written sequentially */
+  
+  writenc1dintfield(natpft_id,innatpft);
+  writenc1dintfield(cft_id,incft);
+  writenc0dfield(EDGEN_id,&inEDGEN);
+  writenc0dfield(EDGEE_id,&inEDGEE);
+  writenc0dfield(EDGES_id,&inEDGES);
+  writenc0dfield(EDGEW_id,&inEDGEW);
+  writenc1dfield(LAT_id,inLAT);
+  writenc2dfield(LATIXY_id,inLATIXY);
+  writenc1dfield(LON_id,inLON);
+  writenc2dfield(LONGXY_id,inLONGXY);
+  writenc2dfield(LANDMASK_id,outLANDMASKGrid);
+  writenc2ddblfield(LANDFRAC_id,outLANDFRACdblGrid);
+  writenc2ddblfield(AREA_id,outAREAdblGrid);
+  writenc2ddblfield(PCT_GLACIER_id,outPCTGLACIERdblGrid);
+  writenc2ddblfield(PCT_LAKE_id,outPCTLAKEdblGrid);
+  writenc2ddblfield(PCT_WETLAND_id,outPCTWETLANDdblGrid);
+  writenc2ddblfield(PCT_URBAN_id,outPCTURBANdblGrid);
+  writenc2ddblfield(PCT_NATVEG_id,outPCTNATVEGdblGrid);
+  writenc2ddblfield(PCT_CROP_id,outPCTCROPdblGrid);
+  
+  writenc3ddblstack(PCT_NAT_PFT_id,outPCTPFTdblStack);
+  writenc3ddblstack(PCT_CFT_id,outPCTCFTdblStack);
+  writenc3ddblstack(FERTNITRO_CFT_id,outFERTNITROdblStack);
+
+  writenc2ddblfield(HARVEST_VH1_id,outRBIOHVH1dblGrid);
+  writenc2ddblfield(HARVEST_VH2_id,outRBIOHVH2dblGrid);
+  writenc2ddblfield(HARVEST_SH1_id,outRBIOHSH1dblGrid);
+  writenc2ddblfield(HARVEST_SH2_id,outRBIOHSH2dblGrid);
+  writenc2ddblfield(HARVEST_SH3_id,outRBIOHSH3dblGrid);
+  writenc2ddblfield(GRAZING_id,outGRAZINGdblGrid);
+
+  writenc3ddblstack(UNREPRESENTED_PFT_LULCC_id,outUNREPPFTdblStack);
+  writenc3ddblstack(UNREPRESENTED_CFT_LULCC_id,outUNREPCFTdblStack);
 
   closencfile();
   
@@ -4038,6 +7209,7 @@ main(long narg, char **argv) {
   for (yearnumber = startyear; yearnumber <= endyear; yearnumber++) {
   
       initializeGrids();
+      planyearreads();
       
       readctsmcurrentGrids(yearnumber);
       readctsmLUHforestGrids(yearnumber);
@@ -4060,7 +7232,10 @@ main(long narg, char **argv) {
       readUNREPSECDNGrids(yearnumber-1);
 
       readLUHcropmanagementGrids(yearnumber);
+      adviseclassicslices();
+      prefetchslices();
       extrapfertGrids();
+      writeextrapstats(yearnumber);
 
       generateLUHcollectionGrids();
       generatectsmURBANGrids();
@@ -4080,6 +7255,10 @@ main(long narg, char **argv) {
 
   }
   
+  completeprefetches();
+  closeallncinputfiles();
+  printslicecachestats();
+  
   return 1;
   
 }